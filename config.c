@@ -0,0 +1,189 @@
+/* USB Keyboard Firmware code for generic Teensy Keyboards
+ * Copyright (c) 2012 Fredrik Atmer, Bathroom Epiphanies Inc
+ * http://www.bathroomepiphanies.com
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Receives config blobs from the host, see config.h. The USB
+   interrupt only checks and copies a chunk into the stage; the main
+   loop writes it to EEPROM a byte per write cycle, like the macro
+   recorder, and the host waits for that before sending the next. */
+
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include "config.h"
+#include "eeprom_map.h"
+#include "lib/usb_keyboard_debug.h"
+
+#if CONFIG_HEADER + CONFIG_BODY > EE_CONFIG_BANK_SIZE
+#error "The key map does not fit a config bank"
+#endif
+
+static uint16_t active = 0;       // EEPROM address of the bank in use, 0 none
+static uint8_t active_seq;
+static uint16_t target;           // bank being written
+
+static volatile uint8_t state = CONFIG_IDLE;
+static volatile uint8_t error = CONFIG_OK;
+static volatile uint16_t received;
+static volatile uint16_t written;
+static uint16_t host_crc;
+static bool header_staged;
+
+// Bytes waiting to be written from stage_addr on. Filled by the USB
+// interrupt or the main loop only while empty.
+static uint8_t stage[CONFIG_CHUNK];
+static volatile uint8_t stage_len = 0;
+static uint8_t stage_pos;
+static uint16_t stage_addr;
+
+static uint16_t body_crc(uint16_t bank) {
+  uint16_t crc = 0xFFFF;
+  for(uint16_t i = 0; i < CONFIG_BODY; i++)
+    crc = _crc16_update(crc, eeprom_read_byte((const uint8_t *)(bank + CONFIG_HEADER + i)));
+  return crc;
+}
+
+static bool bank_valid(uint16_t bank) {
+  return eeprom_read_byte((const uint8_t *)bank) == CONFIG_VERSION &&
+    eeprom_read_word((const uint16_t *)(bank + 2)) == body_crc(bank);
+}
+
+void config_init(void) {
+  bool a = bank_valid(EE_CONFIG_A), b = bank_valid(EE_CONFIG_B);
+  uint8_t seq_a = eeprom_read_byte((const uint8_t *)EE_CONFIG_A + 1);
+  uint8_t seq_b = eeprom_read_byte((const uint8_t *)EE_CONFIG_B + 1);
+  if(a && (!b || (int8_t)(seq_a - seq_b) > 0))
+    active = EE_CONFIG_A, active_seq = seq_a;
+  else if(b)
+    active = EE_CONFIG_B, active_seq = seq_b;
+}
+
+bool config_valid(void) {
+  return active != 0;
+}
+
+const uint8_t *config_keymap(void) {
+  return (const uint8_t *)(active + CONFIG_HEADER);
+}
+
+// Act on a command from the host; returns an error or CONFIG_OK.
+static uint8_t command(const uint8_t *buf) {
+  uint16_t arg = buf[1] | buf[2] << 8;
+  switch(buf[0]) {
+  case CONFIG_BEGIN:
+    if(state == CONFIG_WRITING || stage_len)
+      return CONFIG_BAD_COMMAND;
+    if(buf[1] != CONFIG_VERSION)
+      return CONFIG_BAD_VERSION;
+    if((buf[2] | buf[3] << 8) != CONFIG_BODY)
+      return CONFIG_BAD_LENGTH;
+    target = active == EE_CONFIG_A ? EE_CONFIG_B : EE_CONFIG_A;
+    received = written = 0;
+    header_staged = false;
+    state = CONFIG_RECEIVING;
+    return CONFIG_OK;
+  case CONFIG_DATA:
+    if(state != CONFIG_RECEIVING)
+      return CONFIG_BAD_COMMAND;
+    if(stage_len || arg != received || buf[3] > CONFIG_CHUNK || arg + buf[3] > CONFIG_BODY)
+      return CONFIG_BAD_OFFSET;
+    for(uint8_t i = 0; i < buf[3]; i++)
+      stage[i] = buf[4 + i];
+    stage_addr = target + CONFIG_HEADER + arg;
+    stage_pos = 0;
+    received = arg + buf[3];
+    stage_len = buf[3];
+    return CONFIG_OK;
+  case CONFIG_COMMIT:
+    if(state != CONFIG_RECEIVING)
+      return CONFIG_BAD_COMMAND;
+    if(received != CONFIG_BODY)
+      return CONFIG_BAD_LENGTH;
+    host_crc = arg;
+    state = CONFIG_WRITING;
+    return CONFIG_OK;
+  }
+  return CONFIG_BAD_COMMAND;
+}
+
+// A feature report from the host, from the USB interrupt. A failed
+// command ends the update, unless one is already being written, and
+// the host starts over with CONFIG_BEGIN.
+void usb_debug_feature_set(const uint8_t *buf) {
+  error = command(buf);
+  if(error && state != CONFIG_WRITING)
+    state = CONFIG_FAILED;
+}
+
+// The feature report the host reads, from the USB interrupt.
+void usb_debug_feature_get(uint8_t *buf) {
+  uint16_t r = received, w = written;
+  buf[0] = state;
+  buf[1] = error;
+  buf[2] = CONFIG_VERSION;
+  buf[3] = CONFIG_BODY & 0xFF;
+  buf[4] = CONFIG_BODY >> 8;
+  buf[5] = r & 0xFF;
+  buf[6] = r >> 8;
+  buf[7] = w & 0xFF;
+  buf[8] = w >> 8;
+  buf[9] = active_seq;
+  buf[10] = active != 0;
+}
+
+bool config_task(void) {
+  if(stage_pos < stage_len) {
+    if(!eeprom_is_ready())
+      return false;
+    eeprom_update_byte((uint8_t *)(stage_addr + stage_pos), stage[stage_pos]);
+    if(++stage_pos == stage_len) {
+      if(!header_staged)
+        written += stage_len;
+      stage_len = 0;
+    }
+    return false;
+  }
+  if(state != CONFIG_WRITING || !eeprom_is_ready())
+    return false;
+  if(!header_staged) {
+    // The body is all in EEPROM; check it before it can be used.
+    if(body_crc(target) != host_crc) {
+      error = CONFIG_BAD_CRC;
+      state = CONFIG_FAILED;
+      return false;
+    }
+    stage[0] = CONFIG_VERSION;
+    stage[1] = active_seq + 1;
+    stage[2] = host_crc & 0xFF;
+    stage[3] = host_crc >> 8;
+    stage_addr = target;
+    stage_pos = 0;
+    header_staged = true;
+    stage_len = CONFIG_HEADER;
+    return false;
+  }
+  active = target;
+  active_seq++;
+  state = CONFIG_DONE;
+  return true;
+}
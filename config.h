@@ -0,0 +1,66 @@
+#ifndef config_h__
+#define config_h__
+
+#include <stdint.h>
+#include "lib/avr_extra.h"
+#include KEYBOARD_MODEL
+
+/* A key map pushed by the host over feature reports on the debug
+   interface, with tools/config_push.py, and kept in EEPROM without
+   reflashing. Two banks hold a config blob each:
+
+     0       format version, CONFIG_VERSION
+     1       sequence number, one up on the bank it replaces
+     2-3     CRC-16 (avr-libc _crc16_update, from 0xFFFF) of the body
+     4-      body: NKEY action bytes, the key map
+
+   An update goes to the bank not in use and its header is written
+   last, so a bank whose CRC does not match its body, half written or
+   never written, is ignored and the other one stays in use. Of two
+   good banks the newer one wins. */
+#define CONFIG_VERSION 1
+#define CONFIG_HEADER  4
+#define CONFIG_BODY    NKEY
+
+// Feature report from the host: a command byte and its arguments,
+// little-endian.
+#define CONFIG_BEGIN  1  // version, body length (2)
+#define CONFIG_DATA   2  // offset (2), n, n body bytes
+#define CONFIG_COMMIT 3  // CRC-16 of the body (2)
+#define CONFIG_CHUNK  (USB_DEBUG_FEATURE_SIZE - 4)
+
+// Feature report to the host: state, error, CONFIG_VERSION, body
+// length (2), body bytes received (2), body bytes written to EEPROM
+// (2), sequence number of the bank in use, 1 if there is one. A chunk
+// is only taken once everything before it is written.
+#define CONFIG_IDLE      0
+#define CONFIG_RECEIVING 1
+#define CONFIG_WRITING   2  // committed, being checked and written
+#define CONFIG_DONE      3  // in use
+#define CONFIG_FAILED    4
+
+#define CONFIG_OK          0
+#define CONFIG_BAD_COMMAND 1
+#define CONFIG_BAD_VERSION 2
+#define CONFIG_BAD_LENGTH  3
+#define CONFIG_BAD_OFFSET  4  // out of order, or before the last was written
+#define CONFIG_BAD_CRC     5
+
+#ifdef CONFIG_UPDATE
+void config_init(void);
+bool config_valid(void);       // a pushed key map is stored
+// EEPROM address of the key map in use, read in place: a RAM copy
+// would cost NKEY bytes. A read waits out an EEPROM write in
+// progress, at most 3.4 ms, so only while a push or a macro recording
+// is being written.
+const uint8_t *config_keymap(void);
+// Write received bytes to EEPROM as it becomes ready. True once when
+// a pushed key map has just been put in use. Main loop only.
+bool config_task(void);
+#else
+#define config_init()
+#define config_valid() 0
+#define config_task() false
+#endif
+
+#endif
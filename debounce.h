@@ -0,0 +1,21 @@
+#ifndef debounce_h__
+#define debounce_h__
+
+#include <stdint.h>
+#include KEYBOARD_MODEL
+
+// De-bounced state of the matrix, one byte per row. Bit c is set if
+// the key in column c is considered pressed. Owned by the engine.
+extern uint8_t debounced[NROW];
+
+// Once a row with no pressed keys has given this many open samples
+// in a row, every engine is back at rest and debounce_row() would
+// neither change state nor report anything until a switch closes.
+#define DEBOUNCE_REST 8
+
+// Feed one sample of row r (bit c set = column c closed) to the
+// de-bouncing engine. Returns the columns whose de-bounced state
+// changed; their new state can be read from debounced[r].
+uint8_t debounce_row(uint8_t r, uint8_t cols);
+
+#endif
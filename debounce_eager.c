@@ -0,0 +1,72 @@
+/* USB Keyboard Firmware code for generic Teensy Keyboards
+ * Copyright (c) 2012 Fredrik Atmer, Bathroom Epiphanies Inc
+ * http://www.bathroomepiphanies.com
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Eager de-bouncing, for low press latency. A press is reported on
+   the first closed sample, after which the key ignores its switch for
+   DEBOUNCE_PRESS scans while the contacts settle. A release is only
+   reported after DEBOUNCE_RELEASE open samples in a row.
+
+   A pressed key's counter holds the number of open samples still
+   needed for release, plus the remaining lock out scans on top. */
+
+#include "debounce.h"
+
+#ifndef DEBOUNCE_PRESS
+#define DEBOUNCE_PRESS   5
+#endif
+#ifndef DEBOUNCE_RELEASE
+#define DEBOUNCE_RELEASE 7
+#endif
+
+#if DEBOUNCE_RELEASE < 1 || DEBOUNCE_PRESS + DEBOUNCE_RELEASE > 255
+#error "DEBOUNCE_PRESS and DEBOUNCE_RELEASE out of range"
+#endif
+
+uint8_t debounced[NROW];
+static uint8_t count[NKEY];
+
+uint8_t debounce_row(uint8_t r, uint8_t cols) {
+  uint8_t *n = &count[r * NCOL];
+  uint8_t state = debounced[r];
+  if(!(state | cols))
+    return 0;
+  for(uint8_t bit = 1; bit; bit <<= 1, n++) {
+    if(!(state & bit)) {
+      if(cols & bit) {
+        state |= bit;
+        *n = DEBOUNCE_RELEASE + DEBOUNCE_PRESS;
+      }
+    } else if(*n > DEBOUNCE_RELEASE) {
+      (*n)--;
+    } else if(cols & bit) {
+      *n = DEBOUNCE_RELEASE;
+    } else if(!--(*n)) {
+      state &= ~bit;
+    }
+  }
+  uint8_t changed = state ^ debounced[r];
+  debounced[r] = state;
+  return changed;
+}
@@ -0,0 +1,51 @@
+/* USB Keyboard Firmware code for generic Teensy Keyboards
+ * Copyright (c) 2012 Fredrik Atmer, Bathroom Epiphanies Inc
+ * http://www.bathroomepiphanies.com
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Shift register de-bouncing. Each key keeps its last eight samples
+   in a byte. A key is pressed once the seven most recent samples are
+   closed after an open one, and released once the seven most recent
+   samples are open after a closed one. */
+
+#include "debounce.h"
+
+uint8_t debounced[NROW];
+static uint8_t bounce[NKEY];
+
+uint8_t debounce_row(uint8_t r, uint8_t cols) {
+  uint8_t *b = &bounce[r * NCOL];
+  uint8_t state = debounced[r];
+  for(uint8_t bit = 1; bit; bit <<= 1, b++) {
+    if(cols & bit)
+      *b |= 1;
+    if(*b == 0b01111111)
+      state |= bit;
+    if(*b == 0b10000000)
+      state &= ~bit;
+    *b <<= 1;
+  }
+  uint8_t changed = state ^ debounced[r];
+  debounced[r] = state;
+  return changed;
+}
@@ -0,0 +1,51 @@
+/* USB Keyboard Firmware code for generic Teensy Keyboards
+ * Copyright (c) 2012 Fredrik Atmer, Bathroom Epiphanies Inc
+ * http://www.bathroomepiphanies.com
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Vertical counter de-bouncing. Every key has a 3-bit counter of how
+   many consecutive samples disagreed with its de-bounced state. The
+   counters are stored bit-sliced, one byte per counter bit per row,
+   so all eight columns of a row are counted in parallel with a few
+   logic operations. A key changes state on the seventh disagreeing
+   sample in a row, the same as the shift register engine. */
+
+#include "debounce.h"
+
+uint8_t debounced[NROW];
+static struct {uint8_t b0; uint8_t b1; uint8_t b2;} count[NROW];
+
+uint8_t debounce_row(uint8_t r, uint8_t cols) {
+  uint8_t delta = cols ^ debounced[r];
+  uint8_t b0 = count[r].b0, b1 = count[r].b1, b2 = count[r].b2;
+  // Increment the counters of disagreeing keys, clear the others.
+  b2 = (b2 ^ (b1 & b0)) & delta;
+  b1 = (b1 ^ b0) & delta;
+  b0 = ~b0 & delta;
+  uint8_t changed = b2 & b1 & b0;
+  debounced[r] ^= changed;
+  count[r].b0 = b0 & ~changed;
+  count[r].b1 = b1 & ~changed;
+  count[r].b2 = b2 & ~changed;
+  return changed;
+}
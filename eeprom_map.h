@@ -0,0 +1,23 @@
+#ifndef eeprom_map_h__
+#define eeprom_map_h__
+
+// Where things live in the 1 KB of EEPROM. Erased cells read 0xFF.
+
+// Recorded macros, EE_MACRO_SLOTS slots of EE_MACRO_SLOT_SIZE bytes.
+#define EE_MACRO_BASE      0x000
+#define EE_MACRO_SLOTS     4
+#define EE_MACRO_SLOT_SIZE 160
+#define EE_MACRO_END       (EE_MACRO_BASE + EE_MACRO_SLOTS * EE_MACRO_SLOT_SIZE)
+
+// The layout in use, an index into the LAYOUTS of the image.
+#define EE_LAYOUT          0x280
+
+// Row settle times from settle_calibrate(), one byte per row.
+#define EE_SETTLE          0x281
+
+// The two banks of the config blob pushed by the host, see config.h.
+#define EE_CONFIG_A        0x2A0
+#define EE_CONFIG_B        0x340
+#define EE_CONFIG_BANK_SIZE 0xA0
+
+#endif
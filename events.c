@@ -0,0 +1,75 @@
+/* USB Keyboard Firmware code for generic Teensy Keyboards
+ * Copyright (c) 2012 Fredrik Atmer, Bathroom Epiphanies Inc
+ * http://www.bathroomepiphanies.com
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Lock-free ring of key events. The head index is only written by the
+   producer and the tail index only by the consumer, and both are
+   single bytes, so neither side needs to disable interrupts.
+
+   Pushed events are staged until events_commit(), so the consumer
+   always sees the changes of a whole scan at once. */
+
+#include "events.h"
+
+static struct key_event ring[EVENT_QUEUE_SIZE];
+static volatile uint8_t head = 0;
+static volatile uint8_t tail = 0;
+static uint8_t staged = 0;
+volatile uint8_t event_overruns = 0;
+
+bool event_push(uint8_t key, uint8_t pressed) {
+  uint8_t h = staged;
+  if((uint8_t)(h - tail) == EVENT_QUEUE_SIZE) {
+    event_overruns++;
+    return false;
+  }
+  ring[h % EVENT_QUEUE_SIZE].key = key;
+  ring[h % EVENT_QUEUE_SIZE].pressed = pressed;
+  ring[h % EVENT_QUEUE_SIZE].tick = scan_tick;
+  staged = h + 1;
+  return true;
+}
+
+void events_commit(void) {
+  head = staged;
+}
+
+// Look at a waiting event without taking it, 0 being the next one
+// event_pop() returns.
+bool event_peek(uint8_t i, struct key_event *e) {
+  uint8_t t = tail;
+  if((uint8_t)(head - t) <= i)
+    return false;
+  *e = ring[(uint8_t)(t + i) % EVENT_QUEUE_SIZE];
+  return true;
+}
+
+bool event_pop(struct key_event *e) {
+  uint8_t t = tail;
+  if(t == head)
+    return false;
+  *e = ring[t % EVENT_QUEUE_SIZE];
+  tail = t + 1;
+  return true;
+}
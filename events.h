@@ -0,0 +1,34 @@
+#ifndef events_h__
+#define events_h__
+
+#include <stdint.h>
+#include "lib/avr_extra.h"
+
+// Key events travel from the scan interrupt to the main loop through
+// a single producer, single consumer ring. Must be a power of two,
+// at most 128. The main loop drains it every pass; the longest it
+// holds events back in normal typing is a dual-role key waiting out
+// TAPPING_TERM, and the largest burst is ten fingers pressed and
+// released in that time, 20 events. 32 leaves room over that at 4
+// bytes an event. Anything longer, like typing during a macro
+// replay, overruns and is resynced from the matrix snapshot.
+#define EVENT_QUEUE_SIZE 32
+
+// tick is scan_tick in the scan the event came from, in full, as
+// events can wait in the ring for longer than 256 scans, like while a
+// macro plays back.
+struct key_event {uint8_t key; uint8_t pressed; uint16_t tick;};
+
+// Number of events lost because the ring was full. Only written by
+// the scan interrupt.
+extern volatile uint8_t event_overruns;
+
+// Scans since power-up, counted by the scan interrupt.
+extern volatile uint16_t scan_tick;
+
+bool event_push(uint8_t key, uint8_t pressed);  // scan interrupt only
+void events_commit(void);                       // scan interrupt only
+bool event_pop(struct key_event *e);            // main loop only
+bool event_peek(uint8_t i, struct key_event *e); // main loop only, i-th waiting event
+
+#endif
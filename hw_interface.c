@@ -23,52 +23,138 @@
  * SOFTWARE.
  */
 
+#include <avr/sleep.h>
+#include <avr/wdt.h>
 #include "hw_interface.h"
 
+#ifndef SCAN_UNROLLED
+uint16_t select_row(uint8_t row);
+void settle_row(uint8_t row, uint16_t since);
 void pull_row(uint8_t row);
+uint8_t read_columns(void);
+#endif
 void release_rows(void);
-bool probe_column(uint8_t col);
-void update_leds(uint8_t keyboard_leds);
 void keyboard_init(void);
 void poll_timer_setup(void);
 void poll_timer_enable(void);
 void poll_timer_disable(void);
+void poll_timer_fast(void);
+void poll_timer_slow(void);
+uint16_t poll_timer_period(void);
+void timer1_setup(void);
+void led_set(uint8_t led, uint16_t duty);
+void watchdog_sleep(void);
+uint8_t settle_reference(uint8_t r);
+uint8_t settle_measure(uint8_t r, uint8_t cols);
+
+// Scan once per USB poll interval. The prescaled timer runs at
+// F_CPU/1024 = 15625 Hz; rounding down keeps the scan period just
+// under the poll period so no host poll goes without a fresh scan.
+#define POLL_TIMER_TOP (F_CPU / 1024 * USB_POLL_MS / 1000 - 1)
+#define IDLE_TIMER_TOP (F_CPU / 1024 * IDLE_SCAN_MS / 1000 - 1)
+
+#if IDLE_TIMER_TOP > 255 || IDLE_TIMER_TOP < POLL_TIMER_TOP
+#error "IDLE_SCAN_MS must be between USB_POLL_MS and 16"
+#endif
+
+const   uint8_t                                        led_outputs[3] PROGMEM = LED_OUTPUTS;
+
+static const struct {uint8_t *const pin; const uint8_t bit;} column_pins[NCOL] = COLUMN_PINS;
+const   uint8_t                                        row_bits[NROW] PROGMEM = ROW_BITS;
+
+static inline void drive_row(uint8_t r) {
+  ROW_PORT = (ROW_PORT & ~ROW_MASK) | pgm_read_byte(&row_bits[r]);
+}
+
+// Sample all input ports once and gather the columns of the pulled
+// row into a mask. Bit c is set if the key in column c is closed.
+static inline uint8_t sample_columns(void) {
+  const uint8_t pinb = PINB, pinc = PINC, pind = PIND;
+  return COLUMN_BIT(0) | COLUMN_BIT(1) | COLUMN_BIT(2) | COLUMN_BIT(3) |
+         COLUMN_BIT(4) | COLUMN_BIT(5) | COLUMN_BIT(6) | COLUMN_BIT(7);
+}
 
-struct {uint8_t *const pin; const uint8_t bit;} column_pins[NCOL] = COLUMN_PINS;
-const   uint8_t                                 row_bits[NROW]    = ROW_BITS;
+// With SCAN=unrolled these are inlined from hw_scan.h instead.
+#ifndef SCAN_UNROLLED
+// Drive row r and return the Timer1 count it was driven at. The
+// columns can be read once settle_row() returns, and until then the
+// scan can get on with something else.
+uint16_t select_row(uint8_t r) {
+  drive_row(r);
+  return TCNT1;
+}
+
+// Wait out whatever is left of the settle time of row r, driven at
+// Timer1 count since. Timer1 counts every cycle and wraps at 0xFFFF.
+void settle_row(uint8_t r, uint16_t since) {
+  uint16_t cycles = row_settle[r] * SETTLE_UNIT_CYCLES;
+  while((uint16_t)(TCNT1 - since) < cycles);
+}
 
 void pull_row(uint8_t r) {
-  ROW_PORT = (ROW_PORT & ~ROW_MASK) | row_bits[r];
-  _delay_us(SETTLE_TIME_US);
+  settle_row(r, select_row(r));
 }
 
-void release_rows(void) {
-  PORTD |= ROW_MASK;
-}
-
-bool probe_column(uint8_t c) {
-  return (*column_pins[c].pin & column_pins[c].bit) == 0;
-}
-
-// 2 = scroll lock, 1 = caps lock, 0 = num lock.
-void update_leds(uint8_t keyboard_leds) {
-  // TODO: Replace by some smart definitions in corresponding board.h-files.
-#if defined hoof_h__
-  PORTC = (PORTC & 0b11011111) | ((~keyboard_leds << 4) & 0b00100000); // Caps Lock
-  PORTC = (PORTC & 0b10111111) | ((~keyboard_leds << 4) & 0b01000000); // Scroll Lock
-#elif defined flake_h__
-  PORTB = (PORTB & 0b01111111) | ((~keyboard_leds << 6) & 0b10000000); // Caps Lock
-  PORTC = (PORTC & 0b11011111) | ((~keyboard_leds << 5) & 0b00100000); // Win Lock (used as Scroll Lock)
-  PORTC = (PORTC & 0b10111111) | ((~keyboard_leds << 4) & 0b01000000); // Scroll Lock
-#elif defined paw_h__
-  PORTB = (PORTB & 0b01111111) | ((~keyboard_leds << 5) & 0b10000000); // Scroll Lock
-  PORTC = (PORTC & 0b11011111) | ((~keyboard_leds << 5) & 0b00100000); // Num Lock
-  PORTC = (PORTC & 0b10111111) | ((~keyboard_leds << 5) & 0b01000000); // Caps Lock
-#elif defined petal_h__
-  PORTB = (PORTB & 0b01111111) | ((~keyboard_leds << 5) & 0b10000000); // Scroll Lock
-  PORTC = (PORTC & 0b11011111) | ((~keyboard_leds << 5) & 0b00100000); // Num Lock
-  PORTC = (PORTC & 0b10111111) | ((~keyboard_leds << 5) & 0b01000000); // Caps Lock
+uint8_t read_columns(void) {
+  return sample_columns();
+}
 #endif
+
+// The DDR and PORT registers of a column follow its PIN register.
+// Driving the columns in cols low and letting go again, with the
+// pull-up, is for calibration only.
+#define COLUMN_DDR(c)  (*(column_pins[c].pin + 1))
+#define COLUMN_PULL(c) (*(column_pins[c].pin + 2))
+#define COLUMN_LOW(c)                                   \
+  if(cols & (1<<(c))) {                                 \
+    COLUMN_PULL(c) &= ~column_pins[c].bit;              \
+    COLUMN_DDR(c) |= column_pins[c].bit;                \
+  }
+#define COLUMN_RELEASE(c)                               \
+  if(cols & (1<<(c))) {                                 \
+    COLUMN_DDR(c) &= ~column_pins[c].bit;               \
+    COLUMN_PULL(c) |= column_pins[c].bit;               \
+  }
+
+// Row r read after a long settle, the reference for its calibration.
+uint8_t settle_reference(uint8_t r) {
+  drive_row(r);
+  _delay_us(SETTLE_REFERENCE_US);
+  return sample_columns();
+}
+
+// The shortest wait in settle units after which row r reads as after a
+// long settle, SETTLE_TRIALS times running, with the columns in cols
+// left low before each read as a pressed key in another row could
+// leave them. No held key may connect a column in cols to a row.
+// Each trial runs with interrupts off, so a USB interrupt cannot
+// stretch the wait it measures. 0xFF if no wait is long enough.
+uint8_t settle_measure(uint8_t r, uint8_t cols) {
+  uint8_t ref = settle_reference(r);
+  for(uint8_t units = 0; units < 0xFF; units++) {
+    uint8_t t, settled;
+    for(t = 0; t < SETTLE_TRIALS; t++) {
+      uint8_t intr_state = SREG;
+      cli();
+      COLUMN_LOW(0) COLUMN_LOW(1) COLUMN_LOW(2) COLUMN_LOW(3)
+      COLUMN_LOW(4) COLUMN_LOW(5) COLUMN_LOW(6) COLUMN_LOW(7)
+      _delay_us(1);
+      COLUMN_RELEASE(0) COLUMN_RELEASE(1) COLUMN_RELEASE(2) COLUMN_RELEASE(3)
+      COLUMN_RELEASE(4) COLUMN_RELEASE(5) COLUMN_RELEASE(6) COLUMN_RELEASE(7)
+      settle_wait(units);
+      settled = sample_columns() == ref;
+      SREG = intr_state;
+      if(!settled)
+        break;
+    }
+    if(t == SETTLE_TRIALS)
+      return units;
+  }
+  return 0xFF;
+}
+
+void release_rows(void) {
+  ROW_PORT |= ROW_MASK;
 }
 
 void keyboard_init() {
@@ -83,6 +169,7 @@ void keyboard_init() {
     *output_pins[i].port = *output_pins[i].port  & ~output_pins[i].bits;
   }
   poll_timer_setup();
+  timer1_setup();
 }
 
 void poll_timer_setup(void) {
@@ -91,7 +178,7 @@ void poll_timer_setup(void) {
   TCCR0B |=      // Timer control register 0A
     (1<<CS00) |  // Prescaler 1024, frequency 15.6kHz (Combined with next line)
     (1<<CS02);   // Prescaler 256, frequency 62.5kHz (This line alone)
-  OCR0A = 16;    // Output compare register 0A
+  OCR0A = POLL_TIMER_TOP; // Output compare register 0A
 }
 
 void poll_timer_enable(void) {
@@ -103,3 +190,83 @@ void poll_timer_disable(void) {
   TIMSK0 &=       // Timer interrupt mask register 0
     ~(1<<OCIE0A); // Disable timer interrupt on compare match with OCR0A
 }
+
+// Switch between the full scan rate and the idle scan rate. The
+// counter is restarted so it never has to wrap past a lowered TOP.
+void poll_timer_fast(void) {
+  OCR0A = POLL_TIMER_TOP;
+  TCNT0 = 0;
+}
+
+void poll_timer_slow(void) {
+  OCR0A = IDLE_TIMER_TOP;
+  TCNT0 = 0;
+}
+
+// Cycles between scans at the full scan rate, for instrumentation.
+uint16_t poll_timer_period(void) {
+  uint32_t cycles = (uint32_t)(POLL_TIMER_TOP + 1) * 1024;
+  return cycles > 0xFFFF ? 0xFFFF : cycles;
+}
+
+// Timer1 counts F_CPU cycles from 0 to 0xFFFF in fast PWM mode, so
+// the LED outputs run at 244 Hz and the counter doubles as a free
+// running clock for instrumentation.
+void timer1_setup(void) {
+  TCCR1A = (1<<WGM11);               // Fast PWM, TOP = ICR1
+  TCCR1B = (1<<WGM13) | (1<<WGM12) |
+    (1<<CS10);                       // No prescaling
+  ICR1 = 0xFFFF;
+  for(uint8_t led = 0; led < 3; led++)
+    led_set(led, 0);
+}
+
+// Light lock LED led (2 = scroll lock, 1 = caps lock, 0 = num lock)
+// for duty/0xFFFF of the time. The output is inverted, low from the
+// start of a period until the compare match; at 0 it is disconnected
+// and the pin stays high.
+void led_set(uint8_t led, uint16_t duty) {
+  uint8_t com;
+  switch(pgm_read_byte(&led_outputs[led])) {
+  case LED_OC1A:
+    OCR1A = duty;
+    PORTC |= (1<<6);
+    com = (1<<COM1A1) | (1<<COM1A0);
+    break;
+  case LED_OC1B:
+    OCR1B = duty;
+    PORTC |= (1<<5);
+    com = (1<<COM1B1) | (1<<COM1B0);
+    break;
+  case LED_OC1C:
+    OCR1C = duty;
+    PORTB |= (1<<7);
+    com = (1<<COM1C1) | (1<<COM1C0);
+    break;
+  default:
+    return;
+  }
+  if(duty)
+    TCCR1A |= com;
+  else
+    TCCR1A &= ~com;
+}
+
+// The watchdog only ever wakes the MCU from watchdog_sleep().
+EMPTY_INTERRUPT(WDT_vect);
+
+// Power down until the watchdog interrupt about 16 ms later, or an
+// earlier one such as USB bus activity. The clocks and the timers
+// stop while powered down.
+void watchdog_sleep(void) {
+  cli();
+  wdt_reset();
+  WDTCSR = (1<<WDCE) | (1<<WDE);
+  WDTCSR = (1<<WDIE);                // Interrupt only, 16 ms
+  set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+  sleep_enable();
+  sei();
+  sleep_cpu();
+  sleep_disable();
+  wdt_disable();
+}
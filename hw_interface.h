@@ -5,15 +5,35 @@
 #include <avr/interrupt.h>
 #include <util/delay.h>
 #include "lib/avr_extra.h"
+#include "settle.h"
 #include KEYBOARD_MODEL
 
+#ifndef SCAN_UNROLLED
+uint16_t select_row(uint8_t row);
+void settle_row(uint8_t row, uint16_t since);
 void pull_row(uint8_t row);
+uint8_t read_columns(void);
+#endif
 void release_rows(void);
-bool probe_column(uint8_t col);
-void update_leds(uint8_t keyboard_leds);
 void keyboard_init(void);
 void poll_timer_setup(void);
 void poll_timer_enable(void);
 void poll_timer_disable(void);
+void poll_timer_fast(void);
+void poll_timer_slow(void);
+uint16_t poll_timer_period(void);
+void timer1_setup(void);
+void led_set(uint8_t led, uint16_t duty);
+void watchdog_sleep(void);
+uint8_t settle_reference(uint8_t r);
+uint8_t settle_measure(uint8_t r, uint8_t cols);
+
+// Column c of the pulled row, from ports sampled into the locals
+// pinb, pinc and pind, given a column_pins[] table built from
+// COLUMN_PINS. c is always a constant, so the compiler folds each
+// use into a plain bit test on a sampled port.
+#define COLUMN_PORT(c) (column_pins[c].pin == _PINB ? pinb : \
+                        column_pins[c].pin == _PINC ? pinc : pind)
+#define COLUMN_BIT(c)  ((COLUMN_PORT(c) & column_pins[c].bit) ? 0 : (1<<(c)))
 
 #endif
@@ -0,0 +1,63 @@
+#ifndef hw_scan_h__
+#define hw_scan_h__
+
+// The matrix access of hw_interface.c inlined for SCAN=unrolled. The
+// scan interrupt expands its row code once per row with UNROLL(), so
+// every table lookup below is by a constant and folds away: the row
+// drive value becomes an immediate and each column a single bit test
+// on a sampled port.
+
+#include "hw_interface.h"
+
+static const struct {uint8_t *const pin; const uint8_t bit;} column_pins[NCOL] = COLUMN_PINS;
+static const uint8_t                                        row_bits[NROW]    = ROW_BITS;
+
+static inline __attribute__((always_inline)) uint16_t select_row(uint8_t r) {
+  ROW_PORT = (ROW_PORT & ~ROW_MASK) | row_bits[r];
+  return TCNT1;
+}
+
+static inline __attribute__((always_inline)) void settle_row(uint8_t r, uint16_t since) {
+  uint16_t cycles = row_settle[r] * SETTLE_UNIT_CYCLES;
+  while((uint16_t)(TCNT1 - since) < cycles);
+}
+
+static inline __attribute__((always_inline)) void pull_row(uint8_t r) {
+  settle_row(r, select_row(r));
+}
+
+static inline __attribute__((always_inline)) uint8_t read_columns(void) {
+  const uint8_t pinb = PINB, pinc = PINC, pind = PIND;
+  return COLUMN_BIT(0) | COLUMN_BIT(1) | COLUMN_BIT(2) | COLUMN_BIT(3) |
+         COLUMN_BIT(4) | COLUMN_BIT(5) | COLUMN_BIT(6) | COLUMN_BIT(7);
+}
+
+// UNROLL(n, f) expands to f(0) f(1) ... f(n - 1), for n up to 24.
+#define UNROLL(n, f)  UNROLL_(n, f)
+#define UNROLL_(n, f) UNROLL_##n(f)
+#define UNROLL_1(f)  f(0)
+#define UNROLL_2(f)  UNROLL_1(f)  f(1)
+#define UNROLL_3(f)  UNROLL_2(f)  f(2)
+#define UNROLL_4(f)  UNROLL_3(f)  f(3)
+#define UNROLL_5(f)  UNROLL_4(f)  f(4)
+#define UNROLL_6(f)  UNROLL_5(f)  f(5)
+#define UNROLL_7(f)  UNROLL_6(f)  f(6)
+#define UNROLL_8(f)  UNROLL_7(f)  f(7)
+#define UNROLL_9(f)  UNROLL_8(f)  f(8)
+#define UNROLL_10(f) UNROLL_9(f)  f(9)
+#define UNROLL_11(f) UNROLL_10(f) f(10)
+#define UNROLL_12(f) UNROLL_11(f) f(11)
+#define UNROLL_13(f) UNROLL_12(f) f(12)
+#define UNROLL_14(f) UNROLL_13(f) f(13)
+#define UNROLL_15(f) UNROLL_14(f) f(14)
+#define UNROLL_16(f) UNROLL_15(f) f(15)
+#define UNROLL_17(f) UNROLL_16(f) f(16)
+#define UNROLL_18(f) UNROLL_17(f) f(17)
+#define UNROLL_19(f) UNROLL_18(f) f(18)
+#define UNROLL_20(f) UNROLL_19(f) f(19)
+#define UNROLL_21(f) UNROLL_20(f) f(20)
+#define UNROLL_22(f) UNROLL_21(f) f(21)
+#define UNROLL_23(f) UNROLL_22(f) f(22)
+#define UNROLL_24(f) UNROLL_23(f) f(23)
+
+#endif
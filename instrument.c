@@ -0,0 +1,186 @@
+/* USB Keyboard Firmware code for generic Teensy Keyboards
+ * Copyright (c) 2012 Fredrik Atmer, Bathroom Epiphanies Inc
+ * http://www.bathroomepiphanies.com
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Scan and latency instrumentation. Timer1 counts every cycle and its
+   overflows are counted in software, so a timestamp is 32 bits. A
+   scan is far shorter than the 4 ms it takes the timer to wrap, so
+   scan times only need the 16-bit counter.
+
+   The latency is from the first key edge the scan interrupt finds to
+   the report that carries it being queued on the endpoint, so it
+   includes the wait in the event queue and for a free USB buffer. */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "instrument.h"
+#include "hw_interface.h"
+#include "telemetry.h"
+#include "lib/print.h"
+
+struct instrument_stat scan_stat, latency_stat;
+
+static volatile uint16_t overflows = 0;
+static uint16_t scan_start;
+static uint32_t edge_time;
+static volatile bool edge_pending = false;
+
+ISR(TIMER1_OVF_vect) {
+  overflows++;
+}
+
+static uint32_t timestamp(void) {
+  uint8_t intr_state = SREG;
+  cli();
+  uint16_t t = TCNT1;
+  uint16_t o = overflows;
+  // An overflow that happened with interrupts off is not counted yet.
+  if((TIFR1 & (1<<TOV1)) && t < 0x8000)
+    o++;
+  SREG = intr_state;
+  return (uint32_t)o << 16 | t;
+}
+
+static void stat_reset(struct instrument_stat *s) {
+  s->min = 0xFFFF;
+  s->max = 0;
+  s->sum = 0;
+  s->count = 0;
+  for(uint8_t b = 0; b < INSTRUMENT_BUCKETS; b++)
+    s->buckets[b] = 0;
+}
+
+static void stat_add(struct instrument_stat *s, uint16_t v) {
+  uint8_t b = 0;
+  if(v < s->min)
+    s->min = v;
+  if(v > s->max)
+    s->max = v;
+  if(s->count == 0xFFFF) {
+    s->sum >>= 1;
+    s->count >>= 1;
+  }
+  s->sum += v;
+  s->count++;
+  for(uint16_t x = v; x; x >>= 1)
+    b++;
+  if(s->buckets[b] != 0xFFFF)
+    s->buckets[b]++;
+}
+
+void instrument_init(void) {
+  stat_reset(&scan_stat);
+  stat_reset(&latency_stat);
+  // Timer1 already runs at F_CPU from 0 to 0xFFFF, see timer1_setup().
+  TIMSK1 |= (1<<TOIE1);
+}
+
+void instrument_scan_start(void) {
+  scan_start = TCNT1;
+}
+
+void instrument_scan_end(void) {
+  stat_add(&scan_stat, TCNT1 - scan_start);
+}
+
+void instrument_edge(void) {
+  if(!edge_pending) {
+    edge_time = timestamp();
+    edge_pending = true;
+  }
+}
+
+void instrument_report(void) {
+  if(!edge_pending)
+    return;
+  uint32_t us = (timestamp() - edge_time) / (F_CPU / 1000000);
+  edge_pending = false;
+  stat_add(&latency_stat, us > 0xFFFF ? 0xFFFF : us);
+}
+
+#ifdef TELEMETRY
+// Sent four records, a packet, at a time, as matrix_dump_chatter()
+// does, so the stack never holds more than one packet's worth.
+static void dump_stat(uint8_t type, const struct instrument_stat *s) {
+  struct telemetry_record r[4];
+  uint16_t values[4] = {s->min, s->max, s->count ? s->sum / s->count : 0, s->count};
+  uint8_t n = 0;
+  // arg 0-3 are TELEMETRY_STAT_MIN, _MAX, _MEAN and _COUNT, then the
+  // buckets from TELEMETRY_STAT_BUCKET.
+  for(uint8_t i = 0; i < 4 + INSTRUMENT_BUCKETS; i++) {
+    r[n].type = type;
+    if(i < 4) {
+      r[n].arg = i;
+      r[n].data = values[i];
+    } else {
+      r[n].arg = TELEMETRY_STAT_BUCKET + i - 4;
+      r[n].data = s->buckets[i - 4];
+    }
+    if(++n == 4) {
+      telemetry_send(r, n);
+      n = 0;
+    }
+  }
+  telemetry_send(r, n);
+}
+#else
+static void dump_stat(const char *name, const struct instrument_stat *s) {
+  print_P(name);
+  print(" min ");
+  phex16(s->min);
+  print(" max ");
+  phex16(s->max);
+  print(" mean ");
+  phex16(s->count ? s->sum / s->count : 0);
+  print(" n ");
+  phex16(s->count);
+  print("\n");
+  for(uint8_t b = 0; b < INSTRUMENT_BUCKETS; b++) {
+    phex16(s->buckets[b]);
+    pchar(b == INSTRUMENT_BUCKETS - 1 ? '\n' : ' ');
+  }
+}
+#endif
+
+// Report both statistics and start over. The scan period, in cycles,
+// goes with the scan times so they can be compared.
+void instrument_dump(void) {
+#ifdef TELEMETRY
+  struct telemetry_record period = {TELEMETRY_SCAN_STAT, TELEMETRY_STAT_PERIOD, 0, 0, poll_timer_period()};
+  telemetry_send(&period, 1);
+  dump_stat(TELEMETRY_SCAN_STAT, &scan_stat);
+  dump_stat(TELEMETRY_LATENCY_STAT, &latency_stat);
+#else
+  print("scan period ");
+  phex16(poll_timer_period());
+  print("\n");
+  dump_stat(PSTR("scan cycles"), &scan_stat);
+  dump_stat(PSTR("latency us"), &latency_stat);
+#endif
+  uint8_t intr_state = SREG;
+  cli();
+  stat_reset(&scan_stat);
+  stat_reset(&latency_stat);
+  SREG = intr_state;
+}
@@ -0,0 +1,37 @@
+#ifndef instrument_h__
+#define instrument_h__
+
+#include <stdint.h>
+
+// Timing of the scan interrupt and of key edges until their report is
+// queued, measured with Timer1 running free at F_CPU. Scan times are
+// in cycles, latencies in microseconds.
+
+#define INSTRUMENT_BUCKETS 17  // bucket b counts values of b bits
+
+struct instrument_stat {
+  uint16_t min, max;
+  uint32_t sum;
+  uint16_t count;  // samples in sum, halved along with it when full
+  uint16_t buckets[INSTRUMENT_BUCKETS];
+};
+
+#ifdef INSTRUMENT
+extern struct instrument_stat scan_stat, latency_stat;
+
+void instrument_init(void);
+void instrument_scan_start(void);  // scan interrupt only
+void instrument_scan_end(void);    // scan interrupt only
+void instrument_edge(void);        // scan interrupt only
+void instrument_report(void);      // after a report is queued
+void instrument_dump(void);
+#else
+#define instrument_init()
+#define instrument_scan_start()
+#define instrument_scan_end()
+#define instrument_edge()
+#define instrument_report()
+#define instrument_dump()
+#endif
+
+#endif
@@ -0,0 +1,101 @@
+/* USB Keyboard Firmware code for generic Teensy Keyboards
+ * Copyright (c) 2012 Fredrik Atmer, Bathroom Epiphanies Inc
+ * http://www.bathroomepiphanies.com
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Streams every key event on the debug interface in the key log
+   format of keylog.h. Records are gathered in a packet that goes out
+   when the next one would not fit or KEYLOG_FLUSH_MS after it was
+   begun, so a keystroke costs two bytes and not a telemetry record of
+   eight. A full packet is copied into the telemetry packet buffer to
+   be sent while the next is filled; if that buffer is still busy the
+   packet is dropped and the sync that follows says so. Nothing here
+   ever waits on the host. */
+
+#include <string.h>
+#include "keylog.h"
+#include "snapshot.h"
+#include "telemetry.h"
+#include "lib/usb_keyboard_debug.h"
+
+#ifndef TELEMETRY
+#error "KEYLOG needs TELEMETRY"
+#endif
+
+#define KEYLOG_FLUSH_MS 250
+#define KEYLOG_HEADER   2  // TELEMETRY_KEYLOG and the payload length
+#define KEYLOG_EVENT_MAX (KEYLOG_VARINT_MAX + 1)
+#define KEYLOG_SYNC_MAX  (2 * KEYLOG_VARINT_MAX + 1)
+
+#if KEYLOG_HEADER + KEYLOG_SYNC_MAX + KEYLOG_EVENT_MAX > USB_DEBUG_PACKET_SIZE
+#error "A key log packet must hold a sync and an event"
+#endif
+
+static uint8_t packet[USB_DEBUG_PACKET_SIZE];  // being filled
+static uint8_t len = KEYLOG_HEADER;
+static bool lost = false;
+static uint16_t last_tick;     // scan of the last record
+static uint16_t packet_frame;  // USB frame the packet was begun in
+
+// Hand the packet being filled over to be sent.
+static void seal(void) {
+  if(len == KEYLOG_HEADER)
+    return;
+  if(telemetry_packet_full) {
+    lost = true;
+  } else {
+    packet[0] = TELEMETRY_KEYLOG;
+    packet[1] = len - KEYLOG_HEADER;
+    memset(packet + len, 0, sizeof(packet) - len);
+    memcpy(telemetry_packet, packet, sizeof(packet));
+    telemetry_packet_full = true;
+  }
+  len = KEYLOG_HEADER;
+}
+
+void keylog_event(const struct key_event *e) {
+  struct matrix_snapshot s;
+  snapshot_read(&s);
+  uint16_t tick = e->tick;
+  uint16_t age = s.tick - tick;
+  if(len + KEYLOG_EVENT_MAX > sizeof(packet))
+    seal();
+  uint8_t *p = packet + len;
+  if(len == KEYLOG_HEADER) {
+    packet_frame = usb_frame_number();
+    p = keylog_put(p, (uint32_t)tick << 1 | lost);
+    *p++ = KEYLOG_SYNC;
+    p = keylog_put(p, (uint16_t)(packet_frame - age * USB_POLL_MS));
+    lost = false;
+    last_tick = tick;
+  }
+  p = keylog_put(p, (uint32_t)(uint16_t)(tick - last_tick) << 1 | e->pressed);
+  *p++ = e->key;
+  last_tick = tick;
+  len = p - packet;
+}
+
+void keylog_task(void) {
+  if(len != KEYLOG_HEADER && (uint16_t)(usb_frame_number() - packet_frame) >= KEYLOG_FLUSH_MS)
+    seal();
+}
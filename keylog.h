@@ -0,0 +1,62 @@
+#ifndef keylog_h__
+#define keylog_h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "events.h"
+
+/* Key event log, a compact record of real typing shared by the
+   firmware, tools/telemetry.py and sim/bench. It is a byte stream of
+   records, each a varint v followed by a key byte:
+
+     v key          key event, v = scans since the previous record << 1
+                    | 1 pressed, 0 released
+     v 0xFF f       sync, v = scan_tick << 1 | 1 if records were lost
+                    before it, f = USB frame of that scan (varint)
+
+   Varints are little-endian base 128: 7 bits a byte, the high bit set
+   on all but the last. A key event with a key tapped at a normal pace
+   takes two bytes. The firmware sends the log in TELEMETRY_KEYLOG
+   packets, each starting with a sync so a lost packet loses nothing
+   else, and the host concatenates their payloads into a .keylog
+   file. */
+
+#define KEYLOG_SYNC        0xFF
+#define KEYLOG_VARINT_MAX  3  // bytes, for values up to 21 bits
+
+// Store v at p and return the byte after it.
+static inline uint8_t *keylog_put(uint8_t *p, uint32_t v) {
+  while(v >= 0x80) {
+    *p++ = v | 0x80;
+    v >>= 7;
+  }
+  *p++ = v;
+  return p;
+}
+
+// Read a varint from p into v and return the byte after it, or NULL
+// if it runs past end.
+static inline const uint8_t *keylog_get(const uint8_t *p, const uint8_t *end, uint32_t *v) {
+  uint8_t shift = 0;
+  *v = 0;
+  while(p < end && shift < 7 * KEYLOG_VARINT_MAX) {
+    uint8_t b = *p++;
+    *v |= (uint32_t)(b & 0x7F) << shift;
+    if(!(b & 0x80))
+      return p;
+    shift += 7;
+  }
+  return NULL;
+}
+
+#ifdef KEYLOG
+// Log an event taken from the queue. Main loop only.
+void keylog_event(const struct key_event *e);
+// Hand logged events to telemetry_task() to send. Main loop only.
+void keylog_task(void);
+#else
+#define keylog_event(e)
+#define keylog_task()
+#endif
+
+#endif
@@ -0,0 +1,80 @@
+/* USB Keyboard Firmware code for generic Teensy Keyboards
+ * Copyright (c) 2012 Fredrik Atmer, Bathroom Epiphanies Inc
+ * http://www.bathroomepiphanies.com
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "leds.h"
+#include "hw_interface.h"
+#include "lib/usb_keyboard_debug.h"
+
+static uint8_t shown_effect = 0xFF;  // nothing shown yet
+static uint8_t shown_leds;
+static uint8_t phase;                // step of a blink or breath
+static uint16_t next_frame;          // USB frame of the next step
+
+// The eye sees brightness roughly as the square root of the duty
+// cycle, so the duty grows with the square of the level.
+static uint16_t duty(uint8_t level) {
+  if(level >= LED_LEVELS - 1)
+    return 0xFFFF;
+  return (uint16_t)level * level * (0xFFFF / ((LED_LEVELS - 1) * (LED_LEVELS - 1)));
+}
+
+static void show(uint8_t leds, uint8_t level) {
+  uint16_t d = duty(level);
+  for(uint8_t led = 0; led < NLED; led++)
+    led_set(led, (leds & (1 << led)) ? d : 0);
+}
+
+void leds_task(uint8_t effect) {
+  uint16_t now = usb_frame_number();
+  if(effect != shown_effect) {
+    shown_effect = effect;
+    phase = 0;
+  } else if(effect == LED_OFF) {
+    return;
+  } else if(effect == LED_STEADY) {
+    if(keyboard_leds == shown_leds)
+      return;
+  } else if((int16_t)(now - next_frame) < 0) {
+    return;
+  }
+  switch(effect) {
+  case LED_OFF:
+    show(0, 0);
+    return;
+  case LED_STEADY:
+    shown_leds = keyboard_leds;
+    show(shown_leds, LED_BRIGHTNESS);
+    return;
+  case LED_BLINK:
+    show(phase & 1 ? 0 : 0xFF, LED_BRIGHTNESS);
+    next_frame = now + LED_BLINK_MS;
+    break;
+  case LED_BREATHE:
+    show(0xFF, phase < LED_LEVELS ? phase : 2 * LED_LEVELS - 1 - phase);
+    next_frame = now + LED_BREATHE_MS;
+    break;
+  }
+  phase = (phase + 1) % (2 * LED_LEVELS);
+}
@@ -0,0 +1,32 @@
+#ifndef leds_h__
+#define leds_h__
+
+#include <stdint.h>
+
+// The lock LEDs, in the order of the bits of keyboard_leds.
+#define LED_NUM_LOCK    0
+#define LED_CAPS_LOCK   1
+#define LED_SCROLL_LOCK 2
+#define NLED            3
+
+// Brightness levels, 0 is off and LED_LEVELS - 1 fully on.
+#define LED_LEVELS 32
+#ifndef LED_BRIGHTNESS
+#define LED_BRIGHTNESS (LED_LEVELS - 1)
+#endif
+
+// What the LEDs show: the host's lock state, every LED blinking or
+// breathing to show a mode, or nothing while the bus is suspended.
+#define LED_STEADY  0
+#define LED_BLINK   1
+#define LED_BREATHE 2
+#define LED_OFF     3
+
+#define LED_BLINK_MS   250  // on and off time
+#define LED_BREATHE_MS  32  // time per level, about 2 s a breath
+
+// Called from the main loop. It only touches the PWM outputs when
+// the effect or the host's LED state changed or an effect steps.
+void leds_task(uint8_t effect);
+
+#endif
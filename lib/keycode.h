@@ -23,133 +23,187 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef KEYCODE_H
 #define KEYCODE_H
 
-#define NORMAL   0x00
-#define MODIFIER 0x01
+/* Every key map entry is a single action byte, the class in the top
+ * five bits and an argument in the low three:
+ *   0x00-0xBF  plain key, its HID usage code
+ *   0xC0-0xC7  layer n on while the key is held
+ *   0xC8-0xCF  layer n flipped on each press
+ *   0xD0-0xD7  layer n made the default layer
+ *   0xD8-0xDF  play macro slot n
+ *   0xE0-0xE7  modifier n, the same codes as the HID modifier usages
+ *   0xE8       enter magic mode
+ *   0xF0-0xF7  dual-role key n, one of the TAP_HOLD_KEYS
+ *   0xF8       transparent, use the key of the next lower layer
+ *              switched on, or of the default layer
+ */
+#define ACT_CLASS(a)  ((a) >> 3)
+#define ACT_ARG(a)    ((a) & 0x07)
+
+#define ACT_LAST_KEY  0xBF
+#define ACT_MO        0x18
+#define ACT_TG        0x19
+#define ACT_DF        0x1A
+#define ACT_MACRO     0x1B
+#define ACT_MOD       0x1C
+#define ACT_MAGIC     0x1D
+#define ACT_TAP_HOLD  0x1E
+#define ACT_TRNS      0x1F
 
-#define IS_MODIFIER(key) ((key).type == MODIFIER)
+#define ACTION(class, arg) ((class) << 3 | (arg))
+#define IS_KEY_ACTION(a)   ((a) <= ACT_LAST_KEY)
 
 /* Short names */
-#define KC_NO   {NORMAL, KEY_NO}
+#define KC_NO   KEY_NO
 
-#define KC_LCTL {MODIFIER, 0x01}
-#define KC_LSFT {MODIFIER, 0x02}
-#define KC_LALT {MODIFIER, 0x04}
-#define KC_LGUI {MODIFIER, 0x08}
-#define KC_RCTL {MODIFIER, 0x10}
-#define KC_RSFT {MODIFIER, 0x20}
-#define KC_RALT {MODIFIER, 0x40}
-#define KC_RGUI {MODIFIER, 0x80}
+#define KC_LCTL ACTION(ACT_MOD, 0)
+#define KC_LSFT ACTION(ACT_MOD, 1)
+#define KC_LALT ACTION(ACT_MOD, 2)
+#define KC_LGUI ACTION(ACT_MOD, 3)
+#define KC_RCTL ACTION(ACT_MOD, 4)
+#define KC_RSFT ACTION(ACT_MOD, 5)
+#define KC_RALT ACTION(ACT_MOD, 6)
+#define KC_RGUI ACTION(ACT_MOD, 7)
 
-#define KC_A    {NORMAL, KEY_A}
-#define KC_B    {NORMAL, KEY_B}
-#define KC_C    {NORMAL, KEY_C}
-#define KC_D    {NORMAL, KEY_D}
-#define KC_E    {NORMAL, KEY_E}
-#define KC_F    {NORMAL, KEY_F}
-#define KC_G    {NORMAL, KEY_G}
-#define KC_H    {NORMAL, KEY_H}
-#define KC_I    {NORMAL, KEY_I}
-#define KC_J    {NORMAL, KEY_J}
-#define KC_K    {NORMAL, KEY_K}
-#define KC_L    {NORMAL, KEY_L}
-#define KC_M    {NORMAL, KEY_M}
-#define KC_N    {NORMAL, KEY_N}
-#define KC_O    {NORMAL, KEY_O}
-#define KC_P    {NORMAL, KEY_P}
-#define KC_Q    {NORMAL, KEY_Q}
-#define KC_R    {NORMAL, KEY_R}
-#define KC_S    {NORMAL, KEY_S}
-#define KC_T    {NORMAL, KEY_T}
-#define KC_U    {NORMAL, KEY_U}
-#define KC_V    {NORMAL, KEY_V}
-#define KC_W    {NORMAL, KEY_W}
-#define KC_X    {NORMAL, KEY_X}
-#define KC_Y    {NORMAL, KEY_Y}
-#define KC_Z    {NORMAL, KEY_Z}
-#define KC_1    {NORMAL, KEY_1}
-#define KC_2    {NORMAL, KEY_2}
-#define KC_3    {NORMAL, KEY_3}
-#define KC_4    {NORMAL, KEY_4}
-#define KC_5    {NORMAL, KEY_5}
-#define KC_6    {NORMAL, KEY_6}
-#define KC_7    {NORMAL, KEY_7}
-#define KC_8    {NORMAL, KEY_8}
-#define KC_9    {NORMAL, KEY_9}
-#define KC_0    {NORMAL, KEY_0}
-#define KC_ENT  {NORMAL, KEY_ENTER}
-#define KC_ESC  {NORMAL, KEY_ESCAPE}
-#define KC_BSPC {NORMAL, KEY_BSPACE}
-#define KC_TAB  {NORMAL, KEY_TAB}
-#define KC_SPC  {NORMAL, KEY_SPACE}
-#define KC_MINS {NORMAL, KEY_MINUS}
-#define KC_EQL  {NORMAL, KEY_EQUAL}
-#define KC_LBRC {NORMAL, KEY_LBRACKET}
-#define KC_RBRC {NORMAL, KEY_RBRACKET}
-#define KC_BSLS {NORMAL, KEY_BSLASH}
-#define KC_NUHS {NORMAL, KEY_NONUS_HASH}
-#define KC_SCLN {NORMAL, KEY_SCOLON}
-#define KC_QUOT {NORMAL, KEY_QUOTE}
-#define KC_GRV  {NORMAL, KEY_GRAVE}
-#define KC_COMM {NORMAL, KEY_COMMA}
-#define KC_DOT  {NORMAL, KEY_DOT}
-#define KC_SLSH {NORMAL, KEY_SLASH}
-#define KC_CAPS {NORMAL, KEY_CAPSLOCK}
-#define KC_F1   {NORMAL, KEY_F1}
-#define KC_F2   {NORMAL, KEY_F2}
-#define KC_F3   {NORMAL, KEY_F3}
-#define KC_F4   {NORMAL, KEY_F4}
-#define KC_F5   {NORMAL, KEY_F5}
-#define KC_F6   {NORMAL, KEY_F6}
-#define KC_F7   {NORMAL, KEY_F7}
-#define KC_F8   {NORMAL, KEY_F8}
-#define KC_F9   {NORMAL, KEY_F9}
-#define KC_F10  {NORMAL, KEY_F10}
-#define KC_F11  {NORMAL, KEY_F11}
-#define KC_F12  {NORMAL, KEY_F12}
-#define KC_PSCR {NORMAL, KEY_PSCREEN}
-#define KC_SLCK {NORMAL, KEY_SCKLOCK}
-#define KC_PAUS {NORMAL, KEY_PAUSE}
-#define KC_INS  {NORMAL, KEY_INSERT}
-#define KC_HOME {NORMAL, KEY_HOME}
-#define KC_PGUP {NORMAL, KEY_PGUP}
-#define KC_DEL  {NORMAL, KEY_DELETE}
-#define KC_END  {NORMAL, KEY_END}
-#define KC_PGDN {NORMAL, KEY_PGDOWN}
-#define KC_RGHT {NORMAL, KEY_RIGHT}
-#define KC_LEFT {NORMAL, KEY_LEFT}
-#define KC_DOWN {NORMAL, KEY_DOWN}
-#define KC_UP   {NORMAL, KEY_UP}
-#define KC_NLCK {NORMAL, KEY_NUMLOCK}
-#define KC_PSLS {NORMAL, KEY_KP_SLASH}
-#define KC_PAST {NORMAL, KEY_KP_ASTERISK}
-#define KC_PMNS {NORMAL, KEY_KP_MINUS}
-#define KC_PPLS {NORMAL, KEY_KP_PLUS}
-#define KC_PENT {NORMAL, KEY_KP_ENTER}
-#define KC_P1   {NORMAL, KEY_KP_1}
-#define KC_P2   {NORMAL, KEY_KP_2}
-#define KC_P3   {NORMAL, KEY_KP_3}
-#define KC_P4   {NORMAL, KEY_KP_4}
-#define KC_P5   {NORMAL, KEY_KP_5}
-#define KC_P6   {NORMAL, KEY_KP_6}
-#define KC_P7   {NORMAL, KEY_KP_7}
-#define KC_P8   {NORMAL, KEY_KP_8}
-#define KC_P9   {NORMAL, KEY_KP_9}
-#define KC_P0   {NORMAL, KEY_KP_0}
-#define KC_PDOT {NORMAL, KEY_KP_DOT}
-#define KC_NUBS {NORMAL, KEY_NONUS_BSLASH}
-#define KC_APP  {NORMAL, KEY_APPLICATION}
-#define KC_PEQL {NORMAL, KEY_KP_EQUAL}
-#define KC_PCMM {NORMAL, KEY_KP_COMMA}
-#define KC_BRK  {NORMAL, KEY_PAUSE}
-#define KC_ERAS {NORMAL, KEY_ALT_ERASE}
-#define KC_CLR  {NORMAL, KEY_CLEAR}
+#define KC_A    KEY_A
+#define KC_B    KEY_B
+#define KC_C    KEY_C
+#define KC_D    KEY_D
+#define KC_E    KEY_E
+#define KC_F    KEY_F
+#define KC_G    KEY_G
+#define KC_H    KEY_H
+#define KC_I    KEY_I
+#define KC_J    KEY_J
+#define KC_K    KEY_K
+#define KC_L    KEY_L
+#define KC_M    KEY_M
+#define KC_N    KEY_N
+#define KC_O    KEY_O
+#define KC_P    KEY_P
+#define KC_Q    KEY_Q
+#define KC_R    KEY_R
+#define KC_S    KEY_S
+#define KC_T    KEY_T
+#define KC_U    KEY_U
+#define KC_V    KEY_V
+#define KC_W    KEY_W
+#define KC_X    KEY_X
+#define KC_Y    KEY_Y
+#define KC_Z    KEY_Z
+#define KC_1    KEY_1
+#define KC_2    KEY_2
+#define KC_3    KEY_3
+#define KC_4    KEY_4
+#define KC_5    KEY_5
+#define KC_6    KEY_6
+#define KC_7    KEY_7
+#define KC_8    KEY_8
+#define KC_9    KEY_9
+#define KC_0    KEY_0
+#define KC_ENT  KEY_ENTER
+#define KC_ESC  KEY_ESCAPE
+#define KC_BSPC KEY_BSPACE
+#define KC_TAB  KEY_TAB
+#define KC_SPC  KEY_SPACE
+#define KC_MINS KEY_MINUS
+#define KC_EQL  KEY_EQUAL
+#define KC_LBRC KEY_LBRACKET
+#define KC_RBRC KEY_RBRACKET
+#define KC_BSLS KEY_BSLASH
+#define KC_NUHS KEY_NONUS_HASH
+#define KC_SCLN KEY_SCOLON
+#define KC_QUOT KEY_QUOTE
+#define KC_GRV  KEY_GRAVE
+#define KC_COMM KEY_COMMA
+#define KC_DOT  KEY_DOT
+#define KC_SLSH KEY_SLASH
+#define KC_CAPS KEY_CAPSLOCK
+#define KC_F1   KEY_F1
+#define KC_F2   KEY_F2
+#define KC_F3   KEY_F3
+#define KC_F4   KEY_F4
+#define KC_F5   KEY_F5
+#define KC_F6   KEY_F6
+#define KC_F7   KEY_F7
+#define KC_F8   KEY_F8
+#define KC_F9   KEY_F9
+#define KC_F10  KEY_F10
+#define KC_F11  KEY_F11
+#define KC_F12  KEY_F12
+#define KC_PSCR KEY_PSCREEN
+#define KC_SLCK KEY_SCKLOCK
+#define KC_PAUS KEY_PAUSE
+#define KC_INS  KEY_INSERT
+#define KC_HOME KEY_HOME
+#define KC_PGUP KEY_PGUP
+#define KC_DEL  KEY_DELETE
+#define KC_END  KEY_END
+#define KC_PGDN KEY_PGDOWN
+#define KC_RGHT KEY_RIGHT
+#define KC_LEFT KEY_LEFT
+#define KC_DOWN KEY_DOWN
+#define KC_UP   KEY_UP
+#define KC_NLCK KEY_NUMLOCK
+#define KC_PSLS KEY_KP_SLASH
+#define KC_PAST KEY_KP_ASTERISK
+#define KC_PMNS KEY_KP_MINUS
+#define KC_PPLS KEY_KP_PLUS
+#define KC_PENT KEY_KP_ENTER
+#define KC_P1   KEY_KP_1
+#define KC_P2   KEY_KP_2
+#define KC_P3   KEY_KP_3
+#define KC_P4   KEY_KP_4
+#define KC_P5   KEY_KP_5
+#define KC_P6   KEY_KP_6
+#define KC_P7   KEY_KP_7
+#define KC_P8   KEY_KP_8
+#define KC_P9   KEY_KP_9
+#define KC_P0   KEY_KP_0
+#define KC_PDOT KEY_KP_DOT
+#define KC_NUBS KEY_NONUS_BSLASH
+#define KC_APP  KEY_APPLICATION
+#define KC_PEQL KEY_KP_EQUAL
+#define KC_PCMM KEY_KP_COMMA
+#define KC_BRK  KEY_PAUSE
+#define KC_ERAS KEY_ALT_ERASE
+#define KC_CLR  KEY_CLEAR
 /* Japanese specific */
-#define KC_ZKHK {NORMAL, KEY_GRAVE}
-#define KC_RO   {NORMAL, KEY_INT1}
-#define KC_KANA {NORMAL, KEY_INT2}
-#define KC_JYEN {NORMAL, KEY_INT3}
-#define KC_HENK {NORMAL, KEY_INT4}
-#define KC_MHEN {NORMAL, KEY_INT5}
+#define KC_ZKHK KEY_GRAVE
+#define KC_RO   KEY_INT1
+#define KC_KANA KEY_INT2
+#define KC_JYEN KEY_INT3
+#define KC_HENK KEY_INT4
+#define KC_MHEN KEY_INT5
+/* Layer keys */
+#define KC_TRNS ACTION(ACT_TRNS, 0)
+#define KC_MO1  ACTION(ACT_MO, 1)
+#define KC_MO2  ACTION(ACT_MO, 2)
+#define KC_MO3  ACTION(ACT_MO, 3)
+#define KC_MO4  ACTION(ACT_MO, 4)
+#define KC_MO5  ACTION(ACT_MO, 5)
+#define KC_MO6  ACTION(ACT_MO, 6)
+#define KC_MO7  ACTION(ACT_MO, 7)
+#define KC_TG1  ACTION(ACT_TG, 1)
+#define KC_TG2  ACTION(ACT_TG, 2)
+#define KC_TG3  ACTION(ACT_TG, 3)
+#define KC_TG4  ACTION(ACT_TG, 4)
+#define KC_TG5  ACTION(ACT_TG, 5)
+#define KC_TG6  ACTION(ACT_TG, 6)
+#define KC_TG7  ACTION(ACT_TG, 7)
+#define KC_DF0  ACTION(ACT_DF, 0)
+#define KC_DF1  ACTION(ACT_DF, 1)
+#define KC_DF2  ACTION(ACT_DF, 2)
+#define KC_DF3  ACTION(ACT_DF, 3)
+#define KC_DF4  ACTION(ACT_DF, 4)
+#define KC_DF5  ACTION(ACT_DF, 5)
+#define KC_DF6  ACTION(ACT_DF, 6)
+#define KC_DF7  ACTION(ACT_DF, 7)
+/* Other actions */
+#define KC_MAGC ACTION(ACT_MAGIC, 0)
+#define KC_MAC1 ACTION(ACT_MACRO, 0)
+#define KC_MAC2 ACTION(ACT_MACRO, 1)
+#define KC_MAC3 ACTION(ACT_MACRO, 2)
+#define KC_MAC4 ACTION(ACT_MACRO, 3)
 
 
 /* USB HID Keyboard/Keypad Usage(0x07) */
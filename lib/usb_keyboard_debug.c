@@ -55,15 +55,37 @@
 #define KEYBOARD_INTERFACE  0
 #define KEYBOARD_ENDPOINT   3
 #define KEYBOARD_SIZE       8
+
+// The keyboard endpoints are polled every USB_POLL_MS frames. At 1 ms
+// the second bank lets the next report be loaded while the host
+// fetches the current one. At slower rates a second bank would only
+// queue a report that is already stale when it is sent, so a single
+// bank is used and the main loop merges everything that happened
+// while it waited into the next report.
+#if USB_POLL_MS == 1
 #define KEYBOARD_BUFFER   EP_DOUBLE_BUFFER
+#elif USB_POLL_MS == 2 || USB_POLL_MS == 4 || USB_POLL_MS == 8 || USB_POLL_MS == 10
+#define KEYBOARD_BUFFER   EP_SINGLE_BUFFER
+#else
+#error "USB_POLL_MS must be 1, 2, 4, 8 or 10"
+#endif
 
 #define DEBUG_INTERFACE    1
 #define DEBUG_TX_ENDPOINT  4
-#define DEBUG_TX_SIZE     32
+#define DEBUG_TX_SIZE     USB_DEBUG_PACKET_SIZE
 #define DEBUG_TX_BUFFER   EP_DOUBLE_BUFFER
 
+#define NKRO_INTERFACE      2
+#define NKRO_ENDPOINT       1
+#define NKRO_SIZE          (1+KEYBOARD_NKRO_BYTES)
+#define NKRO_BUFFER       KEYBOARD_BUFFER
+
 static const uint8_t PROGMEM endpoint_config_table[] = {
+#ifdef NKRO
+  1, EP_TYPE_INTERRUPT_IN,  EP_SIZE(NKRO_SIZE) | NKRO_BUFFER,
+#else
   0,
+#endif
   0,
   1, EP_TYPE_INTERRUPT_IN,  EP_SIZE(KEYBOARD_SIZE) | KEYBOARD_BUFFER,
   1, EP_TYPE_INTERRUPT_IN,  EP_SIZE(DEBUG_TX_SIZE) | DEBUG_TX_BUFFER
@@ -146,22 +168,67 @@ static const uint8_t PROGMEM debug_hid_report_desc[] = {
   0x95, DEBUG_TX_SIZE,  // report count
   0x09, 0x75,           // usage
   0x81, 0x02,           // Input (array)
+#ifdef CONFIG_UPDATE
+  0x95, USB_DEBUG_FEATURE_SIZE, // report count
+  0x09, 0x76,           // usage
+  0xB1, 0x02,           // Feature (variable)
+#endif
   0xC0                  // end collection
 };
 
+#ifdef NKRO
+// N-key rollover keyboard, one bit per key code in the report.
+static const uint8_t PROGMEM nkro_hid_report_desc[] = {
+  0x05, 0x01,          // Usage Page (Generic Desktop),
+  0x09, 0x06,          // Usage (Keyboard),
+  0xA1, 0x01,          // Collection (Application),
+  0x75, 0x01,          //   Report Size (1),
+  0x95, 0x08,          //   Report Count (8),
+  0x05, 0x07,          //   Usage Page (Key Codes),
+  0x19, 0xE0,          //   Usage Minimum (224),
+  0x29, 0xE7,          //   Usage Maximum (231),
+  0x15, 0x00,          //   Logical Minimum (0),
+  0x25, 0x01,          //   Logical Maximum (1),
+  0x81, 0x02,          //   Input (Data, Variable, Absolute), ;Modifier byte
+  0x95, 0x05,          //   Report Count (5),
+  0x75, 0x01,          //   Report Size (1),
+  0x05, 0x08,          //   Usage Page (LEDs),
+  0x19, 0x01,          //   Usage Minimum (1),
+  0x29, 0x05,          //   Usage Maximum (5),
+  0x91, 0x02,          //   Output (Data, Variable, Absolute), ;LED report
+  0x95, 0x01,          //   Report Count (1),
+  0x75, 0x03,          //   Report Size (3),
+  0x91, 0x03,          //   Output (Constant),                 ;LED report padding
+  0x95, KEYBOARD_NKRO_BYTES*8, //   Report Count (KEYBOARD_NKRO_BYTES*8),
+  0x75, 0x01,          //   Report Size (1),
+  0x05, 0x07,          //   Usage Page (Key Codes),
+  0x19, 0x00,          //   Usage Minimum (0),
+  0x29, KEYBOARD_NKRO_BYTES*8-1, //   Usage Maximum (KEYBOARD_NKRO_BYTES*8-1),
+  0x81, 0x02,          //   Input (Data, Variable, Absolute), ;Key bitmap
+  0xc0                 // End Collection
+};
+#endif
+
+#ifdef NKRO
+#define CONFIG1_DESC_SIZE        (9+9+9+7+9+9+7+9+9+7)
+#define NUM_INTERFACES           3
+#else
 #define CONFIG1_DESC_SIZE        (9+9+9+7+9+9+7)
+#define NUM_INTERFACES           2
+#endif
 #define KEYBOARD_HID_DESC_OFFSET (9+9)
 #define DEBUG_HID_DESC_OFFSET    (9+9+9+7+9)
+#define NKRO_HID_DESC_OFFSET     (9+9+9+7+9+9+7+9)
 static const uint8_t PROGMEM config1_descriptor[CONFIG1_DESC_SIZE] = {
   // configuration descriptor, USB spec 9.6.3, page 264-266, Table 9-10
   9,                                 // bLength;
   2,                                 // bDescriptorType;
   LSB(CONFIG1_DESC_SIZE),            // wTotalLength
   MSB(CONFIG1_DESC_SIZE),            
-  2,                                 // bNumInterfaces
+  NUM_INTERFACES,                    // bNumInterfaces
   1,                                 // bConfigurationValue
   0,                                 // iConfiguration
-  0xC0,                              // bmAttributes
+  0xE0,                              // bmAttributes (0x20=remote wakeup)
   50,                                // bMaxPower
   // interface descriptor, USB spec 9.6.5, page 267-269, Table 9-12
   9,                                 // bLength
@@ -188,7 +255,7 @@ static const uint8_t PROGMEM config1_descriptor[CONFIG1_DESC_SIZE] = {
   KEYBOARD_ENDPOINT | 0x80,          // bEndpointAddress
   0x03,                              // bmAttributes (0x03=intr)
   KEYBOARD_SIZE, 0,                  // wMaxPacketSize
-  1,                                 // bInterval
+  USB_POLL_MS,                       // bInterval
   // interface descriptor, USB spec 9.6.5, page 267-269, Table 9-12
   9,                                 // bLength
   4,                                 // bDescriptorType
@@ -214,7 +281,35 @@ static const uint8_t PROGMEM config1_descriptor[CONFIG1_DESC_SIZE] = {
   DEBUG_TX_ENDPOINT | 0x80,          // bEndpointAddress
   0x03,                              // bmAttributes (0x03=intr)
   DEBUG_TX_SIZE, 0,                  // wMaxPacketSize
-  1                                  // bInterval
+  1,                                 // bInterval
+#ifdef NKRO
+  // interface descriptor, USB spec 9.6.5, page 267-269, Table 9-12
+  9,                                 // bLength
+  4,                                 // bDescriptorType
+  NKRO_INTERFACE,                    // bInterfaceNumber
+  0,                                 // bAlternateSetting
+  1,                                 // bNumEndpoints
+  0x03,                              // bInterfaceClass (0x03 = HID)
+  0x00,                              // bInterfaceSubClass
+  0x00,                              // bInterfaceProtocol
+  0,                                 // iInterface
+  // HID interface descriptor, HID 1.11 spec, section 6.2.1
+  9,                                 // bLength
+  0x21,                              // bDescriptorType
+  0x11, 0x01,                        // bcdHID
+  0,                                 // bCountryCode
+  1,                                 // bNumDescriptors
+  0x22,                              // bDescriptorType
+  sizeof(nkro_hid_report_desc),      // wDescriptorLength
+  0,
+  // endpoint descriptor, USB spec 9.6.6, page 269-271, Table 9-13
+  7,                                 // bLength
+  5,                                 // bDescriptorType
+  NKRO_ENDPOINT | 0x80,              // bEndpointAddress
+  0x03,                              // bmAttributes (0x03=intr)
+  NKRO_SIZE, 0,                      // wMaxPacketSize
+  USB_POLL_MS,                       // bInterval
+#endif
 };
 
 // If you're desperate for a little extra code memory, these strings
@@ -255,6 +350,10 @@ static struct descriptor_list_struct {
   {0x2100, KEYBOARD_INTERFACE, config1_descriptor+KEYBOARD_HID_DESC_OFFSET, 9},
   {0x2200, DEBUG_INTERFACE, debug_hid_report_desc, sizeof(debug_hid_report_desc)},
   {0x2100, DEBUG_INTERFACE, config1_descriptor+DEBUG_HID_DESC_OFFSET, 9},
+#ifdef NKRO
+  {0x2200, NKRO_INTERFACE, nkro_hid_report_desc, sizeof(nkro_hid_report_desc)},
+  {0x2100, NKRO_INTERFACE, config1_descriptor+NKRO_HID_DESC_OFFSET, 9},
+#endif
   {0x0300, 0x0000, (const uint8_t *)&string0, 4},
   {0x0301, 0x0409, (const uint8_t *)&string1, sizeof(STR_MANUFACTURER)},
   {0x0302, 0x0409, (const uint8_t *)&string2, sizeof(STR_PRODUCT)}
@@ -275,6 +374,15 @@ static volatile uint8_t usb_configuration=0;
 // packet, or send a zero length packet.
 static volatile uint8_t debug_flush_timer=0;
 
+// start of frame count, one per millisecond while configured
+static volatile uint16_t usb_frame_count=0;
+
+// 1 while the host has the bus suspended, with the USB clock frozen
+static volatile uint8_t usb_suspend_state=0;
+
+// whether the host allows us to wake it from suspend
+static uint8_t usb_remote_wakeup_enabled=0;
+
 // which modifier keys are currently pressed
 // 1=left ctrl,    2=left shift,   4=left alt,    8=left gui
 // 16=right ctrl, 32=right shift, 64=right alt, 128=right gui
@@ -283,10 +391,30 @@ uint8_t keyboard_modifier_keys=0;
 // which keys are currently pressed, up to 6 keys may be down at once
 uint8_t keyboard_keys[6]={0,0,0,0,0,0};
 
-// protocol setting from the host.  We use exactly the same report
-// either way, so this variable only stores the setting since we
-// are required to be able to report which setting is in use.
-static uint8_t keyboard_protocol=1;
+#ifdef NKRO
+// which keys are currently pressed, one bit per key code, sent on
+// the NKRO interface while the host uses the report protocol
+uint8_t keyboard_nkro_keys[KEYBOARD_NKRO_BYTES];
+#endif
+
+// the last report queued on each keyboard endpoint, so an identical
+// one is not sent again.  Forgotten (sent_valid cleared) whenever the
+// host may have lost track of it.
+static uint8_t sent_modifier_keys;
+static uint8_t sent_keys[6];
+#ifdef NKRO
+static uint8_t sent_nkro_modifier_keys;
+static uint8_t sent_nkro_keys[KEYBOARD_NKRO_BYTES];
+#endif
+#define SENT_BOOT 1
+#define SENT_NKRO 2
+static volatile uint8_t sent_valid=0;
+
+// protocol setting from the host.  The boot keyboard always sends the
+// same report, but with NKRO the keys only go out on the NKRO
+// interface while this is 1 (report protocol).  In boot protocol
+// (0, BIOS and the like) the 6KRO boot report is used.
+uint8_t keyboard_protocol=1;
 
 // the idle configuration, how often we send the report to the
 // host (ms * 4) even when it hasn't changed
@@ -315,16 +443,54 @@ void usb_init(void) {
   USB_CONFIG();                    // start USB clock
   UDCON = 0;                       // enable attach resistor
   usb_configuration = 0;
-  UDIEN = (1<<EORSTE)|(1<<SOFE);
+  UDIEN = (1<<EORSTE)|(1<<SOFE)|(1<<SUSPE);
   sei();
 }
 
+// restart the PLL and the USB clock stopped by a suspend
+static void usb_clock_on(void) {
+  PLL_CONFIG();
+  while (!(PLLCSR & (1<<PLOCK)));
+  USBCON &= ~(1<<FRZCLK);
+}
+
+// return 1 while the host has suspended the bus
+uint8_t usb_suspended(void) {
+  return usb_suspend_state;
+}
+
+// signal remote wakeup to the suspended host.  0 returned if it was
+// signalled, -1 if the bus is not suspended or the host disallowed it.
+// The host then resumes the bus, which ends the suspend.
+int8_t usb_remote_wakeup(void) {
+  uint8_t intr_state;
+  if (!usb_suspend_state || !usb_remote_wakeup_enabled) return -1;
+  intr_state = SREG;
+  cli();
+  usb_clock_on();
+  if (!(UDCON & (1<<RMWKUP))) UDCON |= (1<<RMWKUP);
+  SREG = intr_state;
+  return 0;
+}
+
 // return 0 if the USB is not configured, or the configuration
 // number selected by the HOST
 uint8_t usb_configured(void) {
   return usb_configuration;
 }
 
+// return the number of frames since the USB was configured, wrapping
+// at 65536
+uint16_t usb_frame_number(void) {
+  uint8_t intr_state;
+  uint16_t n;
+  intr_state = SREG;
+  cli();
+  n = usb_frame_count;
+  SREG = intr_state;
+  return n;
+}
+
 
 // perform a single keystroke
 int8_t usb_keyboard_press(uint8_t key, uint8_t modifier) {
@@ -332,19 +498,68 @@ int8_t usb_keyboard_press(uint8_t key, uint8_t modifier) {
   keyboard_modifier_keys = modifier;
   keyboard_keys[0] = key;
   r = usb_keyboard_send();
-  if (r) return r;
+  if (r < 0) return r;
   keyboard_modifier_keys = 0;
   keyboard_keys[0] = 0;
   return usb_keyboard_send();
 }
 
-// send the contents of keyboard_keys and keyboard_modifier_keys
+// remember the report just queued on endpoint ep
+static void report_sent(uint8_t ep) {
+  uint8_t i;
+#ifdef NKRO
+  if (ep == NKRO_ENDPOINT) {
+    sent_nkro_modifier_keys = keyboard_modifier_keys;
+    for (i=0; i<KEYBOARD_NKRO_BYTES; i++) {
+      sent_nkro_keys[i] = keyboard_nkro_keys[i];
+    }
+    sent_valid |= SENT_NKRO;
+    return;
+  }
+#endif
+  sent_modifier_keys = keyboard_modifier_keys;
+  for (i=0; i<6; i++) {
+    sent_keys[i] = keyboard_keys[i];
+  }
+  sent_valid |= SENT_BOOT;
+}
+
+// is the report for endpoint ep the same as the last one queued
+static uint8_t report_unchanged(uint8_t ep) {
+  uint8_t i;
+#ifdef NKRO
+  if (ep == NKRO_ENDPOINT) {
+    if (!(sent_valid & SENT_NKRO)) return 0;
+    if (sent_nkro_modifier_keys != keyboard_modifier_keys) return 0;
+    for (i=0; i<KEYBOARD_NKRO_BYTES; i++) {
+      if (sent_nkro_keys[i] != keyboard_nkro_keys[i]) return 0;
+    }
+    return 1;
+  }
+#endif
+  if (!(sent_valid & SENT_BOOT)) return 0;
+  if (sent_modifier_keys != keyboard_modifier_keys) return 0;
+  for (i=0; i<6; i++) {
+    if (sent_keys[i] != keyboard_keys[i]) return 0;
+  }
+  return 1;
+}
+
+// send the contents of keyboard_keys and keyboard_modifier_keys, or
+// keyboard_nkro_keys in NKRO mode.  A report the same as the last one
+// is skipped without waiting for the endpoint: 0 is returned when the
+// report was queued, 1 when it was skipped and -1 on error.  The host
+// still gets it again at its idle rate.
 int8_t usb_keyboard_send(void) {
-  uint8_t i, intr_state, timeout;
+  uint8_t i, intr_state, timeout, ep = KEYBOARD_ENDPOINT;
   if (!usb_configuration) return -1;
+#ifdef NKRO
+  if (keyboard_protocol) ep = NKRO_ENDPOINT;
+#endif
+  if (report_unchanged(ep)) return 1;
   intr_state = SREG;
   cli();
-  UENUM = KEYBOARD_ENDPOINT;
+  UENUM = ep;
   timeout = UDFNUML + 50;
   while (1) {
     // are we ready to transmit?
@@ -352,20 +567,32 @@ int8_t usb_keyboard_send(void) {
     SREG = intr_state;
     // has the USB gone offline?
     if (!usb_configuration) return -1;
+    // suspended, the frame counter has stopped
+    if (usb_suspend_state) return -1;
     // have we waited too long?
     if (UDFNUML == timeout) return -1;
     // get ready to try checking again
     intr_state = SREG;
     cli();
-    UENUM = KEYBOARD_ENDPOINT;
+    UENUM = ep;
   }
   UEDATX = keyboard_modifier_keys;
-  UEDATX = 0;
-  for (i=0; i<6; i++) {
-    UEDATX = keyboard_keys[i];
+#ifdef NKRO
+  if (ep == NKRO_ENDPOINT) {
+    for (i=0; i<KEYBOARD_NKRO_BYTES; i++) {
+      UEDATX = keyboard_nkro_keys[i];
+    }
+  } else
+#endif
+  {
+    UEDATX = 0;
+    for (i=0; i<6; i++) {
+      UEDATX = keyboard_keys[i];
+    }
   }
   UEINTX = 0x3A;
   keyboard_idle_count = 0;
+  report_sent(ep);
   SREG = intr_state;
   return 0;
 }
@@ -443,6 +670,8 @@ int8_t usb_debug_putchar(uint8_t c) {
     }
     // has the USB gone offline?
     if (!usb_configuration) return -1;
+    // suspended, the frame counter has stopped
+    if (usb_suspend_state) return -1;
     // get ready to try checking again
     intr_state = SREG;
     cli();
@@ -462,6 +691,28 @@ int8_t usb_debug_putchar(uint8_t c) {
 }
 
 
+// transmit a whole packet of USB_DEBUG_PACKET_SIZE bytes if a buffer
+// is free, without waiting.  0 returned on success, -1 if not sent.
+// do not mix with usb_debug_putchar, which may leave a packet half full
+int8_t usb_debug_write_packet(const uint8_t *buf) {
+  uint8_t i, intr_state;
+  if (!usb_configuration) return -1;
+  intr_state = SREG;
+  cli();
+  UENUM = DEBUG_TX_ENDPOINT;
+  if (!(UEINTX & (1<<RWAL))) {
+    SREG = intr_state;
+    return -1;
+  }
+  for (i=0; i<DEBUG_TX_SIZE; i++) {
+    UEDATX = buf[i];
+  }
+  UEINTX = 0x3A;
+  debug_flush_timer = 0;
+  SREG = intr_state;
+  return 0;
+}
+
 // immediately transmit any buffered output.
 void usb_debug_flush_output(void) {
   uint8_t intr_state;
@@ -503,8 +754,29 @@ ISR(USB_GEN_vect) {
     UECFG1X = EP_SIZE(ENDPOINT0_SIZE) | EP_SINGLE_BUFFER;
     UEIENX = (1<<RXSTPE);
     usb_configuration = 0;
+    usb_remote_wakeup_enabled = 0;
+    // HID: a reset puts the keyboard back on the report protocol
+    keyboard_protocol = 1;
+    sent_valid = 0;
+  }
+  // bus activity after a suspend: the clock has to run again before
+  // the wakeup interrupt can be cleared
+  if ((intbits & (1<<WAKEUPI)) && usb_suspend_state) {
+    usb_clock_on();
+    UDINT &= ~(1<<WAKEUPI);
+    UDIEN = (UDIEN & ~(1<<WAKEUPE)) | (1<<SUSPE);
+    usb_suspend_state = 0;
+  }
+  // the host suspended the bus: stop the PLL and the USB clock, only
+  // the wakeup interrupt works without them
+  if ((intbits & (1<<SUSPI)) && !usb_suspend_state) {
+    UDIEN = (UDIEN & ~(1<<SUSPE)) | (1<<WAKEUPE);
+    USBCON |= (1<<FRZCLK);
+    PLLCSR &= ~(1<<PLLE);
+    usb_suspend_state = 1;
   }
   if ((intbits & (1<<SOFI)) && usb_configuration) {
+    usb_frame_count++;
     t = debug_flush_timer;
     if (t) {
       debug_flush_timer = -- t;
@@ -516,7 +788,13 @@ ISR(USB_GEN_vect) {
         UEINTX = 0x3A;
       }
     }
+#ifdef NKRO
+    // the keys go out on the NKRO interface in report protocol, so
+    // the boot keyboard must not repeat a stale modifier byte
+    if (keyboard_idle_config && !keyboard_protocol && (++div4 & 3) == 0) {
+#else
     if (keyboard_idle_config && (++div4 & 3) == 0) {
+#endif
       UENUM = KEYBOARD_ENDPOINT;
       if (UEINTX & (1<<RWAL)) {
         keyboard_idle_count++;
@@ -528,6 +806,7 @@ ISR(USB_GEN_vect) {
             UEDATX = keyboard_keys[i];
           }
           UEINTX = 0x3A;
+          report_sent(KEYBOARD_ENDPOINT);
         }
       }
     }
@@ -631,6 +910,8 @@ ISR(USB_COM_vect) {
     }
     if (bRequest == SET_CONFIGURATION && bmRequestType == 0) {
       usb_configuration = wValue;
+      keyboard_protocol = 1;
+      sent_valid = 0;
       usb_send_in();
       cfg = endpoint_config_table;
       for (i=1; i<5; i++) {
@@ -663,11 +944,18 @@ ISR(USB_COM_vect) {
         UENUM = 0;
       }
 #endif
+      if (bmRequestType == 0x80 && usb_remote_wakeup_enabled) i = 2;
       UEDATX = i;
       UEDATX = 0;
       usb_send_in();
       return;
     }
+    if ((bRequest == CLEAR_FEATURE || bRequest == SET_FEATURE)
+        && bmRequestType == 0x00 && wValue == 1) {  // DEVICE_REMOTE_WAKEUP
+      usb_remote_wakeup_enabled = (bRequest == SET_FEATURE);
+      usb_send_in();
+      return;
+    }
 #ifdef SUPPORT_ENDPOINT_HALT
     if ((bRequest == CLEAR_FEATURE || bRequest == SET_FEATURE)
         && bmRequestType == 0x02 && wValue == 0) {
@@ -728,13 +1016,68 @@ ISR(USB_COM_vect) {
         }
         if (bRequest == HID_SET_PROTOCOL) {
           keyboard_protocol = wValue;
+          sent_valid = 0;
           //usb_wait_in_ready();
           usb_send_in();
           return;
         }
       }
     }
+#ifdef NKRO
+    if (wIndex == NKRO_INTERFACE) {
+      if (bRequest == HID_GET_REPORT && bmRequestType == 0xA1) {
+        usb_wait_in_ready();
+        UEDATX = keyboard_modifier_keys;
+        for (i=0; i<KEYBOARD_NKRO_BYTES; i++) {
+          UEDATX = keyboard_nkro_keys[i];
+        }
+        usb_send_in();
+        return;
+      }
+      if (bmRequestType == 0x21) {
+        if (bRequest == HID_SET_REPORT) {
+          usb_wait_receive_out();
+          keyboard_leds = UEDATX;
+          usb_ack_out();
+          usb_send_in();
+          return;
+        }
+        if (bRequest == HID_SET_IDLE) {
+          // reports are only ever sent on change
+          usb_send_in();
+          return;
+        }
+      }
+    }
+#endif
     if (wIndex == DEBUG_INTERFACE) {
+#ifdef CONFIG_UPDATE
+      // feature reports, report type 3 in the high byte of wValue,
+      // one packet each
+      if (bRequest == HID_GET_REPORT && bmRequestType == 0xA1 && (wValue >> 8) == 3) {
+        uint8_t buf[USB_DEBUG_FEATURE_SIZE] = {0};
+        usb_debug_feature_get(buf);
+        n = wLength < sizeof(buf) ? wLength : sizeof(buf);
+        usb_wait_in_ready();
+        for (i=0; i<n; i++) {
+          UEDATX = buf[i];
+        }
+        usb_send_in();
+        return;
+      }
+      if (bRequest == HID_SET_REPORT && bmRequestType == 0x21 && (wValue >> 8) == 3) {
+        uint8_t buf[USB_DEBUG_FEATURE_SIZE] = {0};
+        usb_wait_receive_out();
+        n = UEBCLX;
+        for (i=0; i<n && i<sizeof(buf); i++) {
+          buf[i] = UEDATX;
+        }
+        usb_ack_out();
+        usb_send_in();
+        usb_debug_feature_set(buf);
+        return;
+      }
+#endif
       if (bRequest == HID_GET_REPORT && bmRequestType == 0xA1) {
         len = wLength;
         do {
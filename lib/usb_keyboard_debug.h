@@ -6,16 +6,36 @@
 
 void usb_init(void);            // initialize everything
 uint8_t usb_configured(void);   // is the USB port configured
+uint16_t usb_frame_number(void); // frames (ms) since configured
+uint8_t usb_suspended(void);    // has the host suspended the bus
+int8_t usb_remote_wakeup(void); // wake the host, if it allows that
 
 int8_t usb_keyboard_press(uint8_t key, uint8_t modifier);
-int8_t usb_keyboard_send(void);
+int8_t usb_keyboard_send(void);  // 1 if the same as the last report
 void jump_bootloader(void);
 extern uint8_t keyboard_modifier_keys;
 extern uint8_t keyboard_keys[6];
 extern volatile uint8_t keyboard_leds;
+extern uint8_t keyboard_protocol;
+
+// Key codes 0 to KEYBOARD_NKRO_BYTES*8-1 fit in the NKRO bitmap, up
+// to the last plain key code of the key maps (ACT_LAST_KEY, 0xBF).
+#define KEYBOARD_NKRO_BYTES 24
+#ifdef NKRO
+extern uint8_t keyboard_nkro_keys[KEYBOARD_NKRO_BYTES];
+#endif
 
 int8_t usb_debug_putchar(uint8_t c);  // transmit a character
 void usb_debug_flush_output(void);    // immediately transmit any buffered output
+#define USB_DEBUG_PACKET_SIZE 32
+int8_t usb_debug_write_packet(const uint8_t *buf); // one whole packet, never waits
+#ifdef CONFIG_UPDATE
+// Feature reports on the debug interface, handled by the firmware
+// from the USB interrupt (see config.c).
+#define USB_DEBUG_FEATURE_SIZE 32
+void usb_debug_feature_set(const uint8_t *buf);  // the host sent one
+void usb_debug_feature_get(uint8_t *buf);        // the host asks for one
+#endif
 #define USB_DEBUG_HID
 
 // Everything below this point is only intended for usb_serial.c
@@ -34,10 +54,10 @@ void usb_debug_flush_output(void);    // immediately transmit any buffered outpu
 #define EP_SINGLE_BUFFER          0x02
 #define EP_DOUBLE_BUFFER          0x06
 
-#define EP_SIZE(s)  ((s) == 64 ? 0x30 : \
-      ((s) == 32 ? 0x20 : \
-      ((s) == 16 ? 0x10 : \
-                   0x00)))
+#define EP_SIZE(s)  ((s) > 32 ? 0x30 : \
+      ((s) > 16 ? 0x20 : \
+      ((s) > 8  ? 0x10 : \
+                  0x00)))
 
 #define MAX_ENDPOINT    4
 
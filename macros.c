@@ -0,0 +1,188 @@
+/* USB Keyboard Firmware code for generic Teensy Keyboards
+ * Copyright (c) 2012 Fredrik Atmer, Bathroom Epiphanies Inc
+ * http://www.bathroomepiphanies.com
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Persistent macros. Recording goes through a small RAM ring that
+   macro_task() empties into EEPROM one byte per write cycle, so the
+   main loop never waits the 3.4 ms a write takes. Replay reads the
+   slot back in chunks and never holds more than one of them.
+
+   Repeated toggles of the same key, a key tapped over and over, are
+   stored as the key followed by a run-length byte. With MACRO_TIMING
+   the gaps between toggles are stored as wait bytes in between. */
+
+#include <avr/eeprom.h>
+#include "macros.h"
+#ifdef MACRO_TIMING
+#include "lib/usb_keyboard_debug.h"
+#endif
+
+#define STAGE_SIZE 16  // power of two
+#define CHUNK_SIZE 16
+
+static uint8_t stage[STAGE_SIZE];
+static uint8_t stage_head = 0, stage_tail = 0;
+static uint16_t write_addr;
+
+static uint16_t record_end;    // last byte of the slot, kept for MACRO_END
+static uint16_t record_addr;   // next byte of the slot to hand out
+static uint8_t record_key;     // key waiting to be stored, or MACRO_END
+static uint8_t record_run;
+#ifdef MACRO_TIMING
+static uint16_t record_time;   // frame the last toggle was recorded in
+#endif
+
+static uint8_t chunk[CHUNK_SIZE];
+static uint8_t chunk_pos, chunk_len;
+static uint16_t replay_addr, replay_end;
+static uint8_t replay_key, replay_run;
+
+static uint16_t slot_addr(uint8_t slot) {
+  return EE_MACRO_BASE + (uint16_t)(slot % EE_MACRO_SLOTS) * EE_MACRO_SLOT_SIZE;
+}
+
+// Hand a byte to the writer, waiting for it only if the ring is full.
+static void stage_byte(uint8_t b) {
+  while((uint8_t)(stage_head - stage_tail) == STAGE_SIZE)
+    macro_task();
+  stage[stage_head % STAGE_SIZE] = b;
+  stage_head++;
+  record_addr++;
+}
+
+// Store the waiting key and its run. Room for both was set aside
+// when the key was taken.
+static void flush_key(void) {
+  if(record_key == MACRO_END)
+    return;
+  stage_byte(record_key);
+  if(record_run)
+    stage_byte(MACRO_RUN - 1 + record_run);
+  record_key = MACRO_END;
+}
+
+void macro_record_start(uint8_t slot) {
+  while(stage_head != stage_tail)
+    macro_task();
+  record_addr = write_addr = slot_addr(slot);
+  record_end = record_addr + EE_MACRO_SLOT_SIZE - 1;
+  record_key = MACRO_END;
+  record_run = 0;
+#ifdef MACRO_TIMING
+  record_time = usb_frame_number();
+#endif
+}
+
+bool macro_record_key(uint8_t k) {
+  uint16_t wait = 0;
+#ifdef MACRO_TIMING
+  uint16_t now = usb_frame_number();
+  wait = (uint16_t)(now - record_time) / MACRO_WAIT_UNIT;
+  record_time += wait * MACRO_WAIT_UNIT;
+  if(wait > MACRO_WAIT_LIMIT)
+    wait = MACRO_WAIT_LIMIT;
+#endif
+  if(!wait && k == record_key && record_run < MACRO_RUN_MAX - MACRO_RUN + 1) {
+    record_run++;
+    return true;
+  }
+  flush_key();
+  while(wait) {
+    uint8_t n = wait < MACRO_WAIT_MAX - MACRO_WAIT + 1 ? wait : MACRO_WAIT_MAX - MACRO_WAIT + 1;
+    if(record_addr + 3 > record_end)
+      return false;
+    stage_byte(MACRO_WAIT - 1 + n);
+    wait -= n;
+  }
+  if(record_addr + 2 > record_end)
+    return false;
+  record_key = k;
+  record_run = 0;
+  return true;
+}
+
+void macro_record_stop(void) {
+  flush_key();
+  stage_byte(MACRO_END);
+}
+
+void macro_task(void) {
+  if(stage_head == stage_tail || !eeprom_is_ready())
+    return;
+  eeprom_update_byte((uint8_t *)write_addr, stage[stage_tail % STAGE_SIZE]);
+  write_addr++;
+  stage_tail++;
+}
+
+void macro_replay_start(uint8_t slot) {
+  // Whatever was just recorded has to be in EEPROM first.
+  while(stage_head != stage_tail)
+    macro_task();
+  eeprom_busy_wait();
+  replay_addr = slot_addr(slot);
+  replay_end = replay_addr + EE_MACRO_SLOT_SIZE;
+  chunk_pos = chunk_len = 0;
+  replay_key = MACRO_END;
+  replay_run = 0;
+}
+
+static uint8_t next_byte(void) {
+  if(chunk_pos == chunk_len) {
+    if(replay_addr == replay_end)
+      return MACRO_END;
+    chunk_len = replay_end - replay_addr < CHUNK_SIZE ? replay_end - replay_addr : CHUNK_SIZE;
+    eeprom_read_block(chunk, (const void *)replay_addr, chunk_len);
+    replay_addr += chunk_len;
+    chunk_pos = 0;
+  }
+  return chunk[chunk_pos++];
+}
+
+// Get the next step of the macro being played.
+uint8_t macro_replay_next(uint8_t *arg) {
+  if(replay_run) {
+    replay_run--;
+    *arg = replay_key;
+    return MACRO_STEP_KEY;
+  }
+  for(ever) {
+    uint8_t b = next_byte();
+    if(b <= MACRO_KEY_MAX) {
+      *arg = replay_key = b;
+      return MACRO_STEP_KEY;
+    }
+    if(b <= MACRO_RUN_MAX && replay_key != MACRO_END) {
+      replay_run = b - MACRO_RUN;
+      *arg = replay_key;
+      return MACRO_STEP_KEY;
+    }
+    if(b >= MACRO_WAIT && b <= MACRO_WAIT_MAX) {
+      *arg = b - MACRO_WAIT + 1;
+      return MACRO_STEP_WAIT;
+    }
+    if(b == MACRO_END)
+      return MACRO_STEP_END;
+    // A run with no key before it is skipped.
+  }
+}
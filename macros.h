@@ -0,0 +1,45 @@
+#ifndef macros_h__
+#define macros_h__
+
+#include <stdint.h>
+#include "lib/avr_extra.h"
+#include "eeprom_map.h"
+
+// Macros are stored in EEPROM as a stream of key toggles, one byte
+// each. A toggle is a press if the key is up and a release if it is
+// down, like the events they were recorded from.
+#define MACRO_KEY_MAX  0x8F  // 0x00-0x8F: toggle key k
+#define MACRO_RUN      0x90  // 0x90-0xBF: toggle the last key 1-48 more times
+#define MACRO_RUN_MAX  0xBF
+#define MACRO_WAIT     0xC0  // 0xC0-0xFE: wait 1-63 units of MACRO_WAIT_UNIT frames
+#define MACRO_WAIT_MAX 0xFE
+#define MACRO_END      0xFF  // end of macro, also what erased EEPROM reads
+
+// Recorded waits, only written with MACRO_TIMING, are in units of
+// this many USB frames (ms). Gaps longer than MACRO_WAIT_LIMIT units
+// are shortened to it.
+#define MACRO_WAIT_UNIT  8
+#define MACRO_WAIT_LIMIT 250
+
+// Toggles played back per keyboard report.
+#ifndef MACRO_EVENTS_PER_FRAME
+#define MACRO_EVENTS_PER_FRAME 4
+#endif
+
+void macro_record_start(uint8_t slot);
+bool macro_record_key(uint8_t k);  // false once the slot is full
+void macro_record_stop(void);
+
+// Steps of a macro as returned by macro_replay_next().
+#define MACRO_STEP_KEY  0  // toggle key *arg
+#define MACRO_STEP_WAIT 1  // wait *arg units of MACRO_WAIT_UNIT frames
+#define MACRO_STEP_END  2
+
+void macro_replay_start(uint8_t slot);
+uint8_t macro_replay_next(uint8_t *arg);
+
+// Writes recorded bytes to EEPROM as it becomes ready. Called from
+// the main loop.
+void macro_task(void);
+
+#endif
@@ -24,110 +24,484 @@
  */
 
 #include <avr/pgmspace.h>
+#include <avr/eeprom.h>
 #include "lib/usb_keyboard_debug.h"
 #include "lib/print.h"
 #include "hw_interface.h"
+#include "settle.h"
+#ifdef SCAN_UNROLLED
+#include "hw_scan.h"
+#endif
+#include "debounce.h"
+#include "events.h"
+#include "snapshot.h"
+#include "matrix.h"
+#include "macros.h"
+#include "eeprom_map.h"
+#include "telemetry.h"
+#include "keylog.h"
+#include "config.h"
+#include "instrument.h"
+#include "leds.h"
 #include KEYBOARD_MODEL
 
-// Attention key to enter "magic mode".
-#define MAGIC_KEY  KC_RGUI
+// Scans without activity before dropping to the idle scan rate.
+#define IDLE_SCANS (IDLE_TIMEOUT_MS / USB_POLL_MS)
 
-struct {uint8_t type; uint8_t value;} layout[] = KEYBOARD_LAYOUT;
-struct {uint8_t pressed; uint8_t bounce;} key[NKEY];
+// Layer 0 is one of the LAYOUTS, picked in magic mode and kept in
+// EEPROM; the LAYERS follow from 1. All of them live in flash, one
+// action byte per key (see keycode.h), and are read one entry at a
+// time through layer_map[], the flash address of each layer. A key
+// map pushed by the host (see config.h) is one more layout, after the
+// built in ones, read in place from EEPROM; then each layer is read
+// through its reader in layer_read[], so no lookup has to test which
+// kind it is.
+const uint8_t layouts[][NKEY] PROGMEM = {KEYBOARD_LAYOUTS};
+const uint8_t layers[][NKEY] PROGMEM = {KEYBOARD_LAYERS};
+#define NLAYOUT (sizeof(layouts) / sizeof(layouts[0]))
+#define NLAYER  (1 + sizeof(layers) / sizeof(layers[0]))
+const uint8_t *layer_map[NLAYER];
+uint8_t layout = 0;
+#ifdef CONFIG_UPDATE
+uint8_t flash_read(const uint8_t *p) {
+  return pgm_read_byte(p);
+}
+uint8_t eeprom_read(const uint8_t *p) {
+  return eeprom_read_byte(p);
+}
+uint8_t (*layer_read[NLAYER])(const uint8_t *p);
+#define LAYER_ACTION(l, k) layer_read[l](layer_map[l] + (k))
+#else
+#define LAYER_ACTION(l, k) pgm_read_byte(layer_map[l] + (k))
+#endif
+#define NLAYOUT_ALL (NLAYOUT + config_valid())
+
+// Layers switched on by held and toggled layer keys, one bit per
+// layer. The key map in use is the highest one switched on or the
+// default layer, worked out only when a layer key changes it.
+uint8_t layers_held = 0;
+uint8_t layers_toggled = 0;
+uint8_t default_layer = 0;
+uint8_t active_layer = 0;
+
+// The layer each pressed key was looked up on, a nibble per key, so
+// a key is released on the layer it was pressed on.
+uint8_t key_layers[NKEY / 2];
+#define KEY_LAYER(k) ((key_layers[(k) / 2] >> ((k) % 2 * 4)) & 0x0F)
+#define LAYOUT_ACTION(k) LAYER_ACTION(KEY_LAYER(k), k)
+
+uint8_t pressed[NROW];
+uint8_t row_quiet[NROW];
+volatile uint16_t scan_tick = 0;
+
+#define KEY_ROW(k) ((k) / NCOL)
+#define KEY_BIT(k) (1 << ((k) % NCOL))
+#define IS_PRESSED(k) (pressed[KEY_ROW(k)] & KEY_BIT(k))
+
+// Dual-role keys, see TAP_HOLD_KEYS. A press waits in the event
+// queue, with the events behind it, until it is known whether the key
+// is tapped or held. held_role has a bit set for each one that is
+// down and acting as its hold action.
+#ifndef TAPPING_TERM
+#define TAPPING_TERM 200
+#endif
+#define TAPPING_TERM_SCANS (TAPPING_TERM / USB_POLL_MS)
+const struct {uint8_t hold; uint8_t tap; uint8_t with_hold;} tap_holds[] PROGMEM = TAP_HOLD_KEYS;
+#define NTAP_HOLD (sizeof(tap_holds) / sizeof(tap_holds[0]))
+uint8_t held_role[NROW];
+#define IS_HELD_ROLE(k) (held_role[KEY_ROW(k)] & KEY_BIT(k))
+
+#define TAP_HOLD_WAIT 0
+#define TAP_HOLD_TAP  1
+#define TAP_HOLD_HOLD 2
 
-uint8_t replay_buf[255];
-uint8_t replay_buf_len = 0;
 uint8_t queue[7] = {0,0,0,0,0,0,0};
 uint8_t mod_keys = 0;
+bool report_dirty = false;
 uint8_t magic_mode = 0;
 uint8_t recording_mode = 0;
+uint8_t macro_slot = 0;
+uint8_t replaying = 0;
+uint8_t replay_step, replay_arg;  // next step of the macro being played
+uint16_t replay_frame;            // USB frame the next step is due in
+uint16_t idle_scans = 0;          // scans without activity, see scan_activity()
 
 void init(void);
+void layouts_init(void);
+void switch_layout(uint8_t l);
+void map_layout(void);
+void clear_pressed(void);
+void update_active_layer(void);
+void lookup_key(uint8_t k);
 void send(void);
 void key_press(uint8_t k);
 void key_release(uint8_t k);
-void debug_print(void);
+void row_changed(uint8_t r, uint8_t k, uint8_t changed);
+void process_events(void);
+uint8_t tap_hold_resolve(const struct key_event *e);
+void replay_task(void);
+void scan_activity(uint8_t activity);
+void suspend_task(void);
+uint8_t suspend_scan(void);
+
+// Scan row r, whose first key is k, driven at Timer1 count *since.
+// The next row is driven as soon as this one is read, so it settles
+// while this one goes through the filter and the de-bouncing; *since
+// is then when. Returns the row's closed and de-bounced keys.
+static inline __attribute__((always_inline)) uint8_t scan_row(uint8_t r, uint8_t k, uint16_t *since) {
+  settle_row(r, *since);
+  uint8_t cols = read_columns();
+  if(r + 1 < NROW)
+    *since = select_row(r + 1);
+  cols = matrix_filter(r, cols);
+  // Rows at rest skip the de-bouncing engine, which is most of them
+  // most of the time. That is all they skip: the decoders select one
+  // row at a time, so every row is still driven, settled, read and
+  // filtered to see a switch close, and the settling is most of a
+  // quiet scan. An idle board saves that by scanning less often, see
+  // IDLE_SCAN_MS.
+  if(cols)
+    row_quiet[r] = 0;
+  else if(row_quiet[r] < DEBOUNCE_REST)
+    row_quiet[r]++;
+  if(row_quiet[r] < DEBOUNCE_REST || debounced[r]) {
+    uint8_t changed = debounce_row(r, cols);
+    if(changed)
+      row_changed(r, k, changed);
+  }
+  return cols | debounced[r];
+}
 
 ISR(SCAN_INTERRUPT_FUNCTION) {
+  uint8_t activity = 0;
   poll_timer_disable();
-  for(uint8_t r = 0, k = 0; r < NROW; r++) {
-    pull_row(r);
-    for(uint8_t c = 0; c < NCOL; c++, k++) {
-      key[k].bounce |= probe_column(c);
-      if(key[k].bounce == 0b01111111 && !key[k].pressed)
-        key_press(k);
-      if(key[k].bounce == 0b10000000 &&  key[k].pressed)
-        key_release(k);
-      
-      key[k].bounce <<= 1;
-    }
-  }
+  instrument_scan_start();
+  scan_tick++;
+  uint16_t since = select_row(0);
+#ifdef SCAN_UNROLLED
+  // A copy of scan_row() per row, with r and k constants.
+#define SCAN_ROW(r) activity |= scan_row(r, (r) * NCOL, &since);
+  UNROLL(NROW, SCAN_ROW)
+#else
+  for(uint8_t r = 0, k = 0; r < NROW; r++, k += NCOL)
+    activity |= scan_row(r, k, &since);
+#endif
   release_rows();
+  events_commit();
+  snapshot_publish(debounced, scan_tick);
+  scan_activity(activity);
   // if(mod_keys == (uint8_t)(KC_LSFT | KC_RSFT))
   //   jump_bootloader();
-
-  // lights on in magic mode or recording mode
-  if (magic_mode) {
-    update_leds(6);
-  } else if (recording_mode) {
-    update_leds(4);
-  } else {
-    update_leds(keyboard_leds);
-  }
-#ifdef DEBUG
-  debug_print();
-#endif  
+  instrument_scan_end();
   poll_timer_enable();
 }
 
 int main(void) {
   init();
   poll_timer_enable();
-  for(ever);
+  for(ever) {
+    if(replaying)
+      replay_task();
+    else
+      process_events();
+    macro_task();
+    telemetry_task();
+    keylog_task();
+    if(config_task())
+      switch_layout(NLAYOUT);
+    // The LEDs breathe in magic mode and blink while recording.
+    leds_task(magic_mode ? LED_BREATHE : recording_mode ? LED_BLINK : LED_STEADY);
+    suspend_task();
+  }
+}
+
+// While the host has the bus suspended, stop the scan interrupt and
+// the LEDs and sleep, waking up by the watchdog to look at the matrix.
+// The rows are selected through decoders, so only one can be pulled
+// at a time and a pin change on the columns would miss most keys. A
+// newly closed switch wakes the host instead; scanning goes on once
+// the bus resumes, and the ordinary scan then reports the key.
+void suspend_task(void) {
+  if(!usb_suspended())
+    return;
+  poll_timer_disable();
+  leds_task(LED_OFF);
+  while(usb_suspended()) {
+    watchdog_sleep();
+    if(usb_suspended() && suspend_scan())
+      usb_remote_wakeup();
+  }
+  idle_scans = 0;
+  poll_timer_fast();
+  poll_timer_enable();
+}
+
+// One raw pass over the rows. True if a switch is closed that was
+// open in the last scan before the bus was suspended.
+uint8_t suspend_scan(void) {
+  struct matrix_snapshot s;
+  uint8_t closed = 0;
+  snapshot_read(&s);
+  for(uint8_t r = 0; r < NROW; r++) {
+    pull_row(r);
+    closed |= read_columns() & ~s.rows[r];
+  }
+  release_rows();
+  return closed;
+}
+
+// Queue the keys of row r (first key k) whose de-bounced state
+// changed. Everything that talks to USB happens in the main loop, so
+// a slow host never stalls the scan.
+void row_changed(uint8_t r, uint8_t k, uint8_t changed) {
+  for(uint8_t bit = 1; bit; bit <<= 1, k++)
+    if(changed & bit) {
+      event_push(k, (debounced[r] & bit) != 0);
+      telemetry_push(TELEMETRY_EDGE, k, (debounced[r] & bit) != 0);
+      instrument_edge();
+    }
+}
+
+// Drop to the idle scan rate once no switch has been closed or held
+// for IDLE_SCANS scans, and go back to full rate on the first one.
+void scan_activity(uint8_t activity) {
+  if(activity) {
+    if(idle_scans == IDLE_SCANS)
+      poll_timer_fast();
+    idle_scans = 0;
+  } else if(idle_scans < IDLE_SCANS && ++idle_scans == IDLE_SCANS) {
+    poll_timer_slow();
+  }
+}
+
+// Act on queued key events and send the result as a single report.
+// A batch only holds presses or only releases, so a quick tap that
+// waited in the queue is never merged away: when the batch cannot be
+// sent yet, the event that would start the next one stays queued
+// until a later pass has sent it. If events were lost,
+// re-synchronise the pressed keys with the de-bounced matrix so
+// nothing gets stuck.
+void process_events(void) {
+  static uint8_t overruns = 0;
+  static uint8_t batch_pressed = 0;
+  struct key_event e;
+  while(!replaying && event_peek(0, &e)) {
+    if(report_dirty && e.pressed != batch_pressed) {
+      send();
+      if(report_dirty)
+        break;
+    }
+    if(e.pressed && !IS_PRESSED(e.key) && !magic_mode) {
+      lookup_key(e.key);
+      if(ACT_CLASS(LAYOUT_ACTION(e.key)) == ACT_TAP_HOLD) {
+        uint8_t role = tap_hold_resolve(&e);
+        if(role == TAP_HOLD_WAIT)
+          break;
+        if(role == TAP_HOLD_HOLD)
+          held_role[KEY_ROW(e.key)] |= KEY_BIT(e.key);
+      }
+    }
+    event_pop(&e);
+    keylog_event(&e);
+    batch_pressed = e.pressed;
+    if(e.pressed && !IS_PRESSED(e.key))
+      key_press(e.key);
+    if(!e.pressed && IS_PRESSED(e.key))
+      key_release(e.key);
+  }
+  if(overruns != event_overruns) {
+    struct matrix_snapshot s;
+    overruns = event_overruns;
+    telemetry_push(TELEMETRY_OVERRUN, 0, overruns);
+    snapshot_read(&s);
+    for(uint8_t r = 0, k = 0; r < NROW; r++)
+      for(uint8_t bit = 1; bit; bit <<= 1, k++) {
+        if((s.rows[r] & bit) && !(pressed[r] & bit))
+          key_press(k);
+        if(!(s.rows[r] & bit) && (pressed[r] & bit))
+          key_release(k);
+      }
+  }
+  send();
 }
 
+// Decide whether the dual-role key pressed in event e, the next one
+// in the queue, is tapped or held, from the events queued behind it
+// and the time since. Until then nothing behind it is acted on, so the
+// order of keys is kept.
+uint8_t tap_hold_resolve(const struct key_event *e) {
+  struct key_event next;
+  struct matrix_snapshot s;
+  for(uint8_t i = 1; event_peek(i, &next); i++) {
+    if(next.key == e->key)
+      return (uint16_t)(next.tick - e->tick) < TAPPING_TERM_SCANS ? TAP_HOLD_TAP : TAP_HOLD_HOLD;
+#ifdef HOLD_ON_OTHER_PRESS
+    if(next.pressed)
+      return TAP_HOLD_HOLD;
+#endif
+  }
+  snapshot_read(&s);
+  if((uint16_t)(s.tick - e->tick) >= TAPPING_TERM_SCANS)
+    return TAP_HOLD_HOLD;
+  return TAP_HOLD_WAIT;
+}
+
+// Send the report if a key changed since the last send. The USB code
+// skips it if the host already has the same report, like when one of
+// two keys on the same modifier bit is released, and if the endpoint
+// stayed busy or the bus is suspended it is tried again on the next
+// call, after the bus resumes.
 void send(void) {
   uint8_t i;
+  int8_t r;
+  if(!report_dirty)
+    return;
   for(i = 0; i < 6; i++)
     keyboard_keys[i] = queue[i];
   keyboard_modifier_keys = mod_keys;
-  usb_keyboard_send();
+  r = usb_keyboard_send();
+  report_dirty = r < 0;
+  if(r < 0)
+    return;
+  // Either way the host has the keys as they are now.
+  instrument_report();
+#ifdef TELEMETRY
+  if(r == 0) {
+    for(i = 0; i < 6 && queue[i]; i++);
+    telemetry_push(TELEMETRY_REPORT, mod_keys, i);
+  }
+#endif
 }
 
-// Low-level key press.
+// Low-level key press. With NKRO, keys go straight into the bitmap
+// report unless the host asked for the boot protocol.
+#if KEYBOARD_NKRO_BYTES * 8 <= ACT_LAST_KEY
+#error "The NKRO bitmap must hold every plain key code"
+#endif
 void ll_key_press(uint8_t k) {
   uint8_t i;
+  report_dirty = true;
+#ifdef NKRO
+  if(keyboard_protocol) {
+    keyboard_nkro_keys[k / 8] |= 1 << (k % 8);
+    return;
+  }
+#endif
   for(i = 5; i > 0; i--) 
     queue[i] = queue[i-1];
   queue[0] = k;
-  send();
 }
 
 void ll_modifier_press(uint8_t mod) {
   mod_keys |= mod;
-  send();
+  report_dirty = true;
 }
 
 // Low-level key release.
 void ll_key_release(uint8_t k) {
   uint8_t i;
+  report_dirty = true;
+#ifdef NKRO
+  if(keyboard_protocol) {
+    keyboard_nkro_keys[k / 8] &= ~(1 << (k % 8));
+    return;
+  }
+#endif
   for(i = 0; i < 6; i++) 
     if(queue[i]==k)
       break;
   for(; i < 6; i++)
     queue[i] = queue[i+1];
-  send();
 }
 
 void ll_modifier_release(uint8_t mod) {
   mod_keys &= ~mod;
-  send();
+  report_dirty = true;
+}
+
+// Point the layers at their key maps, with the layout saved in
+// EEPROM, or the first one, as layer 0.
+void layouts_init(void) {
+  for(uint8_t l = 1; l < NLAYER; l++) {
+    layer_map[l] = layers[l - 1];
+#ifdef CONFIG_UPDATE
+    layer_read[l] = flash_read;
+#endif
+  }
+  layout = eeprom_read_byte((uint8_t *)EE_LAYOUT);
+  if(layout >= NLAYOUT_ALL)
+    layout = 0;
+  map_layout();
 }
 
-uint8_t is_magic_key(uint8_t k) {
-  struct {uint8_t type; uint8_t value;} magic = MAGIC_KEY;
-  return layout[k].type == magic.type
-      && layout[k].value == magic.value;
+// Point layer 0 at the key map of the layout.
+void map_layout(void) {
+#ifdef CONFIG_UPDATE
+  if(layout >= NLAYOUT) {
+    layer_map[0] = config_keymap();
+    layer_read[0] = eeprom_read;
+    return;
+  }
+  layer_read[0] = flash_read;
+#endif
+  layer_map[0] = layouts[layout];
+}
+
+// Switch layer 0 to layout l and save the choice. Keys held now would
+// be released on a different key map, so they are dropped.
+void switch_layout(uint8_t l) {
+  layout = l;
+  map_layout();
+  eeprom_update_byte((uint8_t *)EE_LAYOUT, layout);
+  clear_pressed();
+}
+
+void next_layout(void) {
+  switch_layout(layout + 1 < NLAYOUT_ALL ? layout + 1 : 0);
+}
+
+// Work out the key map in use after a layer key changed a layer.
+void update_active_layer(void) {
+  uint8_t on = layers_held | layers_toggled | (1 << default_layer);
+  active_layer = 7;
+  while(!(on & 0x80)) {
+    on <<= 1;
+    active_layer--;
+  }
+  if(active_layer >= NLAYER)
+    active_layer = default_layer;
+}
+
+// Find the layer pressed key k is taken from and remember it for the
+// release. Transparent keys fall through to the next lower layer that
+// is switched on, down to the default layer.
+void lookup_key(uint8_t k) {
+  uint8_t on = layers_held | layers_toggled;
+  uint8_t l = active_layer;
+  while(l != default_layer && ACT_CLASS(LAYER_ACTION(l, k)) == ACT_TRNS)
+    do
+      l--;
+    while(l != default_layer && !(on & (1 << l)));
+  key_layers[k / 2] = (key_layers[k / 2] & (0xF0 >> (k % 2 * 4))) | (l << (k % 2 * 4));
+}
+
+void layer_key_press(uint8_t class, uint8_t l) {
+  if(l >= NLAYER)
+    return;
+  if(class == ACT_MO)
+    layers_held |= 1 << l;
+  else if(class == ACT_TG)
+    layers_toggled ^= 1 << l;
+  else
+    default_layer = l;
+  update_active_layer();
+}
+
+void layer_key_release(uint8_t class, uint8_t l) {
+  if(class == ACT_MO && l < NLAYER) {
+    layers_held &= ~(1 << l);
+    update_active_layer();
+  }
 }
 
 // Reset all key states, used before recording and replay.
@@ -136,144 +510,262 @@ void clear_pressed(void)
   uint8_t i;
 
   // Set all keys to unpressed, clear USB queue and modifiers.
-  for (i = 0; i < NKEY; ++i) {
-    key[i].pressed = 0;
+  for (i = 0; i < NROW; ++i) {
+    pressed[i] = 0;
+    held_role[i] = 0;
   }
   for (i = 0; i < 7; ++i) {
     queue[i] = 0;
   }
+#ifdef NKRO
+  for (i = 0; i < KEYBOARD_NKRO_BYTES; ++i) {
+    keyboard_nkro_keys[i] = 0;
+  }
+#endif
   mod_keys = 0;
+  // The releases of held layer keys are lost along with the rest.
+  layers_held = 0;
+  update_active_layer();
 
   // Send as a USB command for good measure.
+  report_dirty = true;
   send();
 }
 
+// Start playing back the selected macro slot. Key events from the
+// matrix wait in the queue until it is done.
 void replay_keypresses(void)
 {
-  uint8_t i, k;
-
+  if(macro_slot >= EE_MACRO_SLOTS)
+    return;
   clear_pressed();
+  macro_replay_start(macro_slot);
+  replay_step = macro_replay_next(&replay_arg);
+  replay_frame = usb_frame_number();
+  replaying = 1;
+}
 
-  // Go through all keys in the replay buf. We can determine whether
-  // a command is a key press or release based on whether the key
-  // is already pressed.
-  for (i = 0; i < replay_buf_len; ++i) {
-    k = replay_buf[i];
-    if (!key[k].pressed) {
-      key_press(k);
+// Play the next few steps of the macro, at most one report per USB
+// poll interval with up to MACRO_EVENTS_PER_FRAME keys toggled in it.
+// We can determine whether a toggle is a key press or release based
+// on whether the key is already pressed; like process_events(), a
+// report only holds presses or only releases.
+void replay_task(void) {
+  uint8_t n = 0, batch_pressed = 0;
+  if((int16_t)(usb_frame_number() - replay_frame) < 0)
+    return;
+  while(replay_step == MACRO_STEP_KEY && n < MACRO_EVENTS_PER_FRAME) {
+    uint8_t press = !IS_PRESSED(replay_arg);
+    if(n && press != batch_pressed)
+      break;
+    batch_pressed = press;
+    if(press) {
+      key_press(replay_arg);
     } else {
-      key_release(k);
+      key_release(replay_arg);
     }
+    n++;
+    replay_step = macro_replay_next(&replay_arg);
   }
+  send();
+  replay_frame = usb_frame_number() + USB_POLL_MS;
+  if(replay_step == MACRO_STEP_WAIT) {
+    replay_frame += replay_arg * MACRO_WAIT_UNIT;
+    replay_step = macro_replay_next(&replay_arg);
+  }
+  if(replay_step == MACRO_STEP_END)
+    replaying = 0;
 }
 
 // Hook function invoked for key presses when we are in
-// magic mode.
-void magic_key_press(uint8_t k) {
-  if (is_magic_key(k)) {
+// magic mode; a is the action of the key, and plain keys are
+// picked by their key code.
+void magic_key_press(uint8_t a) {
+  switch(a) {
+  case KC_MAGC:
     magic_mode = 0;
-  }
-  if (layout[k].value == KEY_X) {
+    break;
+  case KC_X:
     ll_key_press(KEY_X);
+    send();
     ll_key_release(KEY_X);
+    send();
     ll_key_press(KEY_X);
+    send();
     ll_key_release(KEY_X);
-  }
+    send();
+    break;
   // Replay recorded keypresses:
-  if (layout[k].value == KEY_R) {
+  case KC_R:
     magic_mode = 0;
     replay_keypresses();
-  }
+    break;
   // Activate bootloader:
-  if (layout[k].value == KEY_B) {
+  case KC_B:
     jump_bootloader();
+    break;
+  // Dump and reset the chatter counts:
+  case KC_C:
+    matrix_dump_chatter();
+    break;
+  // Dump and reset the scan and latency statistics:
+  case KC_D:
+    instrument_dump();
+    break;
+  // Switch to the next layout:
+  case KC_L:
+    next_layout();
+    break;
+  // Select the macro slot for Q and R:
+  case KC_1 ... KC_1 + EE_MACRO_SLOTS - 1:
+    macro_slot = a - KC_1;
+    break;
   }
 }
 
 // Hook function invoked for key releases in magic mode.
-void magic_key_release(uint8_t k) {
+void magic_key_release(uint8_t a) {
   // Start recording keypresses?
   // We must start recording on key release, not press; otherwise
   // the release of the "start recording" keypress will be recorded.
-  if (layout[k].value == KEY_Q) {
+  if (a == KC_Q) {
     recording_mode = 1;
-    replay_buf_len = 0;
+    macro_record_start(macro_slot);
     magic_mode = 0;
     clear_pressed();
   }
+  // Calibrate the row settle times, with the last key up.
+  if (a == KC_S)
+    settle_calibrate();
 }
 
 void add_to_replay_buf(uint8_t k)
 {
-  if (replay_buf_len + 1 < sizeof(replay_buf)) {
-    replay_buf[replay_buf_len] = k;
-    ++replay_buf_len;
-  } else {
+  if (!macro_record_key(k)) {
+    // The slot is full; what fit is kept.
     recording_mode = 0;
+    macro_record_stop();
   }
 }
 
-void key_press(uint8_t k) {
-  key[k].pressed = true;
-  if (magic_mode) {
-    magic_key_press(k);
-  } else if (is_magic_key(k)) {
+void action_press(uint8_t k, uint8_t a);
+void action_release(uint8_t k, uint8_t a);
+
+// A dual-role key goes down or up as its hold action, or as its tap
+// action, with the hold action around it for with_hold. Both are
+// plain keys, modifiers or layer keys.
+void tap_hold_press(uint8_t k, uint8_t n) {
+  if(n >= NTAP_HOLD)
+    return;
+  uint8_t hold = pgm_read_byte(&tap_holds[n].hold);
+  if(IS_HELD_ROLE(k) || pgm_read_byte(&tap_holds[n].with_hold))
+    action_press(k, hold);
+  if(!IS_HELD_ROLE(k))
+    action_press(k, pgm_read_byte(&tap_holds[n].tap));
+}
+
+void tap_hold_release(uint8_t k, uint8_t n) {
+  if(n >= NTAP_HOLD)
+    return;
+  uint8_t hold = pgm_read_byte(&tap_holds[n].hold);
+  if(!IS_HELD_ROLE(k))
+    action_release(k, pgm_read_byte(&tap_holds[n].tap));
+  if(IS_HELD_ROLE(k) || pgm_read_byte(&tap_holds[n].with_hold))
+    action_release(k, hold);
+  held_role[KEY_ROW(k)] &= ~KEY_BIT(k);
+}
+
+void action_press(uint8_t k, uint8_t a) {
+  switch(ACT_CLASS(a)) {
+  case 0 ... ACT_CLASS(ACT_LAST_KEY):
+    ll_key_press(a);
+    break;
+  case ACT_MOD:
+    ll_modifier_press(1 << ACT_ARG(a));
+    break;
+  case ACT_MO:
+  case ACT_TG:
+  case ACT_DF:
+    layer_key_press(ACT_CLASS(a), ACT_ARG(a));
+    break;
+  case ACT_MACRO:
+    // Not from inside a recording or a replay.
+    if (!recording_mode && !replaying) {
+      macro_slot = ACT_ARG(a);
+      replay_keypresses();
+    }
+    break;
+  case ACT_MAGIC:
     // Pressing the magic key activates magic mode, except
     // if we're in recording mode, in which case it exits
     // recording mode.
     if (recording_mode) {
       recording_mode = 0;
+      macro_record_stop();
     } else {
       magic_mode = 1;
     }
-  } else {
-    if (recording_mode) {
-      add_to_replay_buf(k);
-    }
-    if(IS_MODIFIER(layout[k])) {
-      ll_modifier_press(layout[k].value);
-    } else {
-      ll_key_press(layout[k].value);
-    }
+    break;
+  case ACT_TAP_HOLD:
+    tap_hold_press(k, ACT_ARG(a));
+    break;
+  case ACT_TRNS:
+    break;
   }
 }
 
+void action_release(uint8_t k, uint8_t a) {
+  switch(ACT_CLASS(a)) {
+  case 0 ... ACT_CLASS(ACT_LAST_KEY):
+    ll_key_release(a);
+    break;
+  case ACT_MOD:
+    ll_modifier_release(1 << ACT_ARG(a));
+    break;
+  case ACT_MO:
+    layer_key_release(ACT_MO, ACT_ARG(a));
+    break;
+  case ACT_TAP_HOLD:
+    tap_hold_release(k, ACT_ARG(a));
+    break;
+  }
+}
+
+void key_press(uint8_t k) {
+  pressed[KEY_ROW(k)] |= KEY_BIT(k);
+  lookup_key(k);
+  uint8_t a = LAYOUT_ACTION(k);
+  if (magic_mode) {
+    magic_key_press(a);
+    return;
+  }
+  if (recording_mode && a != KC_MAGC) {
+    add_to_replay_buf(k);
+  }
+  action_press(k, a);
+}
+
 void key_release(uint8_t k) {
-  key[k].pressed = false;
+  pressed[KEY_ROW(k)] &= ~KEY_BIT(k);
+  uint8_t a = LAYOUT_ACTION(k);
   if (magic_mode) {
-    magic_key_release(k);
-  } else {
-    if (recording_mode) {
-      add_to_replay_buf(k);
-    }
-    if(IS_MODIFIER(layout[k])) {
-      ll_modifier_release(layout[k].value);
-    } else {
-      ll_key_release(layout[k].value);
-    }
+    magic_key_release(a);
+    return;
+  }
+  if (recording_mode) {
+    add_to_replay_buf(k);
   }
+  action_release(k, a);
 }
 
 void init(void) {
   usb_init();
   while(!usb_configured());
   keyboard_init();
+  config_init();
+  layouts_init();
+  settle_init();
+  instrument_init();
   mod_keys = 0;
-  for(uint8_t k = 0; k < NKEY; k++)
-    key[k].bounce = key[k].pressed = 0x00;
   sei();
 }
-
-uint8_t debug_counter = 0;
-void debug_print(void) {
-  debug_counter++;
-  if(debug_counter > 100) {
-    debug_counter = 0;
-    for(uint8_t i = 0; i < 7; i++)
-      phex(queue[i]);
-    print("\n");
-    for(uint8_t k = 0; k < NKEY; k++)
-      phex(key[k].bounce);
-    print("\n");
-  }
-}
@@ -0,0 +1,108 @@
+/* USB Keyboard Firmware code for generic Teensy Keyboards
+ * Copyright (c) 2012 Fredrik Atmer, Bathroom Epiphanies Inc
+ * http://www.bathroomepiphanies.com
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Checks on the raw row samples before they reach the de-bouncing
+   engine.
+
+   Without diodes, three closed switches on the corners of a rectangle
+   in the matrix make the fourth corner read as closed too. Two rows
+   that share two or more closed columns are such a rectangle, and
+   nothing tells the real switches from the ghost. With GHOST_FILTER,
+   keys on such a row can be released but not pressed until the
+   rectangle is gone. Rows are compared with the latest sample of the
+   others, which for the rows below is one scan old.
+
+   A raw sample that disagrees with the de-bounced state and then
+   agrees again without the state changing is a bounce the engine
+   swallowed. Every switch does that a little on its edges; a worn one
+   does it a lot, so the count per key says which one to replace. The
+   counts take a byte of RAM per key, so only CHATTER_STATS builds
+   keep them. */
+
+#include "matrix.h"
+#include "debounce.h"
+#include "telemetry.h"
+#include "lib/print.h"
+
+#ifdef CHATTER_STATS
+uint8_t chatter[NKEY];
+#endif
+static uint8_t raw[NROW];
+
+uint8_t matrix_filter(uint8_t r, uint8_t cols) {
+#ifdef CHATTER_STATS
+  uint8_t glitch = (raw[r] ^ debounced[r]) & ~(cols ^ debounced[r]);
+  if(glitch) {
+    for(uint8_t k = r * NCOL; glitch; glitch >>= 1, k++)
+      if((glitch & 1) && chatter[k] != 0xFF)
+        chatter[k]++;
+  }
+#endif
+  raw[r] = cols;
+#ifdef GHOST_FILTER
+  if(cols & (cols - 1)) {
+    for(uint8_t s = 0; s < NROW; s++) {
+      uint8_t shared = cols & raw[s];
+      if(s != r && (shared & (shared - 1)))
+        return cols & debounced[r];
+    }
+  }
+#endif
+  return cols;
+}
+
+#ifdef CHATTER_STATS
+// Report the keys that chattered since the last dump and start over.
+void matrix_dump_chatter(void) {
+#ifdef TELEMETRY
+  struct telemetry_record records[4];
+  uint8_t n = 0;
+#endif
+  for(uint8_t k = 0; k < NKEY; k++) {
+    if(!chatter[k])
+      continue;
+#ifdef TELEMETRY
+    records[n].type = TELEMETRY_CHATTER;
+    records[n].arg = k;
+    records[n].data = chatter[k];
+    if(++n == 4) {
+      telemetry_send(records, n);
+      n = 0;
+    }
+#else
+    phex(k);
+    pchar(':');
+    phex(chatter[k]);
+    pchar(' ');
+#endif
+    chatter[k] = 0;
+  }
+#ifdef TELEMETRY
+  telemetry_send(records, n);
+#else
+  print("\n");
+#endif
+}
+#endif
@@ -0,0 +1,23 @@
+#ifndef matrix_h__
+#define matrix_h__
+
+#include <stdint.h>
+#include KEYBOARD_MODEL
+
+#ifdef CHATTER_STATS
+// Bounces swallowed by the de-bouncing engine, per key, saturating.
+extern uint8_t chatter[NKEY];
+#endif
+
+// Take the raw sample of row r, count its bounces, and with
+// GHOST_FILTER mask out closures that could be ghosts. Returns the
+// sample to de-bounce. Scan interrupt only.
+uint8_t matrix_filter(uint8_t r, uint8_t cols);
+
+#ifdef CHATTER_STATS
+void matrix_dump_chatter(void);
+#else
+#define matrix_dump_chatter()
+#endif
+
+#endif
@@ -14,12 +14,51 @@
 #define VENDOR_ID        0x16C0
 
 #define SCAN_INTERRUPT_FUNCTION TIMER0_COMPA_vect
-#define SETTLE_TIME_US 1
+#define SETTLE_TIME_US 1  // until calibrated, see settle.h
+
+/* How often the host polls the keyboard, in ms. The matrix is
+   scanned at the same rate. Normally set from the Makefile. */
+#ifndef USB_POLL_MS
+#define USB_POLL_MS 1
+#endif
+
+/* After IDLE_TIMEOUT_MS without a closed or bouncing switch, the
+   matrix is only scanned every IDLE_SCAN_MS (at most 16), until the
+   next switch closes. */
+#ifndef IDLE_TIMEOUT_MS
+#define IDLE_TIMEOUT_MS 2000
+#endif
+#ifndef IDLE_SCAN_MS
+#define IDLE_SCAN_MS 8
+#endif
+
+/* Timer1 compare outputs that can drive a lock LED, for the
+   LED_OUTPUTS of a model: num lock, caps lock and scroll lock. The
+   LEDs are lit by pulling the pin low. */
+#define LED_NONE 0
+#define LED_OC1A 1  // PC6
+#define LED_OC1B 2  // PC5
+#define LED_OC1C 3  // PB7
 
 #define NROW  18
 #define NCOL   8
 #define NKEY 144
 
+/* Dual-role keys, for the layouts. Each acts as hold when held for
+   TAPPING_TERM ms, or with HOLD_ON_OTHER_PRESS as soon as another key
+   goes down while it is held, and as tap when released before that.
+   With the last field set the tap is sent with hold applied, as in
+   the space cadet shifts. */
+#define KC_CESC ACTION(ACT_TAP_HOLD, 0)  // Ctrl, or Esc when tapped
+#define KC_LSPO ACTION(ACT_TAP_HOLD, 1)  // Left Shift, or (
+#define KC_RSPC ACTION(ACT_TAP_HOLD, 2)  // Right Shift, or )
+#define TAP_HOLD_KEYS           \
+  {                             \
+    {KC_LCTL, KC_ESC, 0},       \
+    {KC_LSFT, KC_9,   1},       \
+    {KC_RSFT, KC_0,   1},       \
+  }
+
 /* Convert physical keyboard layout to matrix array. This is a macro
    to define keymap easily in keyboard layout form. All ANSI ISO JIS
    Layouts are on the same PCB */
@@ -72,7 +111,7 @@
          TAB,    Q,   W,   E,   R,   T,   Y,   U,   I,   O,   P,LBRC,RBRC,BSLS,   DEL, END,PGDN,    P7,  P8,  P9,PPLS, \
          CAPS,   A,   S,   D,   F,   G,   H,   J,   K,   L,SCLN,QUOT,      ENT,                     P4,  P5,  P6,      \
          LSFT,NUBS,   Z,   X,   C,   V,   B,   N,   M,COMM, DOT,SLSH,     RSFT,          UP,        P1,  P2,  P3,PENT, \
-         LCTL,LGUI,LALT,                SPC,               RALT,RGUI, APP,RCTL,   LEFT,DOWN,RGHT,   P0,     PDOT       )
+         LCTL,LGUI,LALT,                SPC,               RALT,MAGC, APP,RCTL,   LEFT,DOWN,RGHT,   P0,     PDOT       )
 
 #define DVORAK \
   KEYMAP(ESC,        F1,  F2,  F3,  F4,  F5,  F6,  F7,  F8,  F9, F10, F11, F12,  PSCR,SLCK,PAUS,                       \
@@ -80,7 +119,34 @@
          TAB, QUOT,COMM, DOT,   P,   Y,   F,   G,   C,   R,   L,SLSH, EQL,BSLS,   DEL, END,PGDN,    P7,  P8,  P9,PPLS, \
          CAPS,   A,   O,   E,   U,   I,   D,   H,   T,   N,   S,MINS,      ENT,                     P4,  P5,  P6,      \
          LSFT,NUBS,SCLN,   Q,   J,   K,   X,   B,   M,   W,   V,   Z,     RSFT,         UP,         P1,  P2,  P3,PENT, \
-         LCTL,LGUI,LALT,                SPC,               RALT,RGUI, APP,RCTL,  LEFT,DOWN,RGHT,    P0,     PDOT       )
+         LCTL,LGUI,LALT,                SPC,               RALT,MAGC, APP,RCTL,  LEFT,DOWN,RGHT,    P0,     PDOT       )
+
+/* The two layouts above with a function key in place of App, for use
+   with LAYOUT = ANSI_ISO_JIS_FN and LAYERS = DVORAK_FN,FN_LAYER.
+   Fn+F1 makes QWERTY the default layer, Fn+F2 makes it Dvorak. */
+#define ANSI_ISO_JIS_FN \
+  KEYMAP(ESC,        F1,  F2,  F3,  F4,  F5,  F6,  F7,  F8,  F9, F10, F11, F12,  PSCR,SLCK,PAUS,                       \
+         GRV,    1,   2,   3,   4,   5,   6,   7,   8,   9,   0,MINS, EQL,BSPC,   INS,HOME,PGUP,  NLCK,PSLS,PAST,PMNS, \
+         TAB,    Q,   W,   E,   R,   T,   Y,   U,   I,   O,   P,LBRC,RBRC,BSLS,   DEL, END,PGDN,    P7,  P8,  P9,PPLS, \
+         CAPS,   A,   S,   D,   F,   G,   H,   J,   K,   L,SCLN,QUOT,      ENT,                     P4,  P5,  P6,      \
+         LSFT,NUBS,   Z,   X,   C,   V,   B,   N,   M,COMM, DOT,SLSH,     RSFT,          UP,        P1,  P2,  P3,PENT, \
+         LCTL,LGUI,LALT,                SPC,               RALT,MAGC, MO2,RCTL,   LEFT,DOWN,RGHT,   P0,     PDOT       )
+
+#define DVORAK_FN \
+  KEYMAP(ESC,        F1,  F2,  F3,  F4,  F5,  F6,  F7,  F8,  F9, F10, F11, F12,  PSCR,SLCK,PAUS,                       \
+         GRV,    1,   2,   3,   4,   5,   6,   7,   8,   9,   0,LBRC,RBRC,BSPC,   INS,HOME,PGUP,  NLCK,PSLS,PAST,PMNS, \
+         TAB, QUOT,COMM, DOT,   P,   Y,   F,   G,   C,   R,   L,SLSH, EQL,BSLS,   DEL, END,PGDN,    P7,  P8,  P9,PPLS, \
+         CAPS,   A,   O,   E,   U,   I,   D,   H,   T,   N,   S,MINS,      ENT,                     P4,  P5,  P6,      \
+         LSFT,NUBS,SCLN,   Q,   J,   K,   X,   B,   M,   W,   V,   Z,     RSFT,         UP,         P1,  P2,  P3,PENT, \
+         LCTL,LGUI,LALT,                SPC,               RALT,MAGC, MO2,RCTL,  LEFT,DOWN,RGHT,    P0,     PDOT       )
+
+#define FN_LAYER \
+  KEYMAP(TRNS,       DF0, DF1,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,  TRNS,TRNS,TRNS,                       \
+         TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,  TRNS,TRNS,TRNS,  TRNS,TRNS,TRNS,TRNS, \
+         TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,  TRNS,TRNS,TRNS,  TRNS,TRNS,TRNS,TRNS, \
+         TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,     TRNS,                   TRNS,TRNS,TRNS,      \
+         TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,TRNS,     TRNS,        TRNS,      TRNS,TRNS,TRNS,TRNS, \
+         TRNS,TRNS,TRNS,               TRNS,               TRNS,TRNS, MO2,TRNS,   TRNS,TRNS,TRNS, TRNS,     TRNS       )
 
 #define TEST_FLAKE \
   KEYMAP(ESC,        F1,  F2,  F3,  F4,  F5,  F6,  F7,  F8,  F9, F10, F11, F12,  PSCR,SLCK,PAUS,                       \
@@ -88,7 +154,7 @@
          TAB,    Q,   W,   E,   R,   T,   Y,   U,   I,   O,   P,LBRC,RBRC,BSLS,   DEL, END,PGDN,    P7,  P8,  P9,PPLS, \
          CAPS,   A,   S,   D,   F,   G,   H,   J,   K,   L,SCLN,QUOT,      ENT,                     P4,  P5,  P6,      \
          LSFT,NUBS,   Z,   X,   C,   V,   B,   N,   M,COMM, DOT,SLSH,     RSFT,          UP,        P1,  P2,  P3,PENT, \
-         LCTL,LGUI,LALT,                SPC,               RALT,RGUI,NLCK,RCTL,   LEFT,DOWN,RGHT,   P0,     PDOT       )
+         LCTL,LGUI,LALT,                SPC,               RALT,MAGC,NLCK,RCTL,   LEFT,DOWN,RGHT,   P0,     PDOT       )
 
 
 /* Test layouts to easily find the position of keys in the underlying
@@ -114,7 +180,7 @@
     KC_0,   KC_1,   KC_2,   KC_3,   KC_4,   KC_5,   KC_6,   KC_7,   /* ROW P */ \
     KC_0,   KC_1,   KC_2,   KC_3,   KC_4,   KC_5,   KC_6,   KC_7,   /* ROW Q */ \
     KC_0,   KC_1,   KC_2,   KC_3,   KC_4,   KC_5,   KC_6,   KC_7    /* ROW R */ \
-  };
+  }
 #define TEST_ROWS \
 /*  COL 0   COL 1   COL 2   COL 3   COL 4   COL 5   COL 6   COL 7 */ \
   { \
@@ -136,6 +202,6 @@
     KC_P,   KC_P,   KC_P,   KC_P,   KC_P,   KC_P,   KC_P,   KC_P,   /* ROW P */ \
     KC_Q,   KC_Q,   KC_Q,   KC_Q,   KC_Q,   KC_Q,   KC_Q,   KC_Q,   /* ROW Q */ \
     KC_R,   KC_R,   KC_R,   KC_R,   KC_R,   KC_R,   KC_R,   KC_R    /* ROW R */ \
-  };
+  }
 
 #endif
@@ -23,5 +23,6 @@
   }
 #define INPUT_PINS  {{_DDRB, _PORTB, 0b00000000}, {_DDRC, _PORTC, 0b10000100}, {_DDRD, _PORTD, 0b01110111}}
 #define OUTPUT_PINS {{_DDRB, _PORTB, 0b11111110}, {_DDRC, _PORTC, 0b01100000}, {_DDRD, _PORTD, 0b00000000}}
+#define LED_OUTPUTS {LED_OC1B, LED_OC1C, LED_OC1A}  // num lock is the Win Lock LED
 
 #endif
@@ -23,5 +23,6 @@
   }
 #define INPUT_PINS  {{_DDRB, _PORTB, 0b11111111}, {_DDRC, _PORTC, 0b00000000}, {_DDRD, _PORTD, 0b00000000}}
 #define OUTPUT_PINS {{_DDRB, _PORTB, 0b00000000}, {_DDRC, _PORTC, 0b01100000}, {_DDRD, _PORTD, 0b01111011}}
+#define LED_OUTPUTS {LED_NONE, LED_OC1B, LED_OC1A}
 
 #endif
@@ -0,0 +1,71 @@
+/* USB Keyboard Firmware code for generic Teensy Keyboards
+ * Copyright (c) 2012 Fredrik Atmer, Bathroom Epiphanies Inc
+ * http://www.bathroomepiphanies.com
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Per-row settle times. The slowest thing after a row is pulled is a
+   column that was low, through a pressed key in the row before,
+   coming back up through its pull-up alone. Calibration leaves every
+   column that no held key connects to a row driven low for a moment,
+   lets go of it and times how soon the pulled row reads the same as
+   after a long settle. A row that never does keeps its old time. */
+
+#include <avr/eeprom.h>
+#include "settle.h"
+#include "hw_interface.h"
+#include "eeprom_map.h"
+#include "lib/print.h"
+
+uint8_t row_settle[NROW];
+
+void settle_init(void) {
+  eeprom_read_block(row_settle, (const void *)EE_SETTLE, NROW);
+  for(uint8_t r = 0; r < NROW; r++)
+    if(row_settle[r] == 0xFF)
+      row_settle[r] = SETTLE_DEFAULT;
+}
+
+void settle_calibrate(void) {
+  uint8_t held = 0;
+  poll_timer_disable();
+  for(uint8_t r = 0; r < NROW; r++)
+    held |= settle_reference(r);
+  for(uint8_t r = 0; r < NROW; r++) {
+    uint8_t units = settle_measure(r, ~held);
+    if(units == 0xFF)
+      continue;
+    units += units / 2 + SETTLE_MARGIN;
+    row_settle[r] = units < 0xFF ? units : 0xFE;
+    eeprom_update_byte((uint8_t *)EE_SETTLE + r, row_settle[r]);
+  }
+  release_rows();
+  poll_timer_enable();
+#ifndef TELEMETRY
+  print("settle");
+  for(uint8_t r = 0; r < NROW; r++) {
+    pchar(' ');
+    phex(row_settle[r]);
+  }
+  print("\n");
+#endif
+}
@@ -0,0 +1,34 @@
+#ifndef settle_h__
+#define settle_h__
+
+#include <stdint.h>
+#include <util/delay_basic.h>
+#include KEYBOARD_MODEL
+
+// Time to wait after pulling a row before reading the columns, per
+// row, in units of the 3 cycles one _delay_loop_1() iteration takes.
+// Set by settle_calibrate() and kept in EEPROM; rows never calibrated
+// wait SETTLE_TIME_US.
+#define SETTLE_UNIT_CYCLES 3
+#define SETTLE_DEFAULT ((SETTLE_TIME_US * (F_CPU / 1000000) + SETTLE_UNIT_CYCLES - 1) / SETTLE_UNIT_CYCLES)
+
+// Calibration compares reads after each wait with one after this
+// long, over this many trials, and adds half the wait found plus
+// SETTLE_MARGIN units.
+#define SETTLE_REFERENCE_US 20
+#define SETTLE_TRIALS       32
+#define SETTLE_MARGIN       2
+
+extern uint8_t row_settle[NROW];
+
+static inline __attribute__((always_inline)) void settle_wait(uint8_t units) {
+  if(units)
+    _delay_loop_1(units);
+}
+
+void settle_init(void);
+// Measure and store the settle time of every row. Stops scanning for
+// a moment and should run with no keys held. Main loop only.
+void settle_calibrate(void);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef sim_avr_eeprom_h__
+#define sim_avr_eeprom_h__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Backed by a RAM array in sim/hw_sim.c; writes finish at once.
+uint8_t eeprom_read_byte(const uint8_t *addr);
+void eeprom_update_byte(uint8_t *addr, uint8_t value);
+void eeprom_read_block(void *dst, const void *src, size_t n);
+void eeprom_update_block(const void *src, void *dst, size_t n);
+#define eeprom_is_ready() 1
+#define eeprom_busy_wait()
+
+#endif
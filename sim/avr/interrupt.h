@@ -0,0 +1,11 @@
+#ifndef sim_avr_interrupt_h__
+#define sim_avr_interrupt_h__
+
+#include <avr/io.h>
+
+// Interrupt handlers become plain functions the bench calls itself.
+#define ISR(vector, ...) void vector(void); void vector(void)
+#define sei()
+#define cli()
+
+#endif
@@ -0,0 +1,14 @@
+/* Host stand-ins for the AVR registers the firmware core touches. The
+   pins and timers are never real; sim/hw_sim.c decides what they do. */
+#ifndef sim_avr_io_h__
+#define sim_avr_io_h__
+
+#include <stdint.h>
+
+extern volatile uint8_t PINB, PINC, PIND;
+extern volatile uint8_t DDRB, DDRC, DDRD;
+extern volatile uint8_t PORTB, PORTC, PORTD;
+extern volatile uint8_t SREG;
+extern volatile uint8_t CLKPR, MCUCR;
+
+#endif
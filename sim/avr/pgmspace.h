@@ -0,0 +1,13 @@
+#ifndef sim_avr_pgmspace_h__
+#define sim_avr_pgmspace_h__
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define memcpy_P memcpy
+
+#endif
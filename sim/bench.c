@@ -0,0 +1,431 @@
+/* Host bench for the firmware core. Synthetic key traces (or a trace
+   file) are turned into bouncing switch samples, scanned through the
+   real scan interrupt, de-bouncing engine, event queue and report
+   builder, and every report that comes out is checked against what
+   the keys were really doing.
+
+     sim/bench             run every built-in trace
+     sim/bench FILE        run a trace file, lines of "ms key 1|0"
+     sim/bench FILE.keylog run a key log saved by tools/telemetry.py
+
+   For each trace it prints host time per scan, key events per second
+   of host time, keys that never made it into a report or were
+   reported more often than pressed, and the latency from the first
+   closure (or opening) of a switch to the report showing it.
+
+   The time per scan is host time, for comparing builds with each
+   other; it says nothing about the 16 MHz budget. AVR cycles come
+   from tools/build_report.py (counted from the disassembly, with make
+   matrix) and INSTRUMENT builds (measured on the part); until one of
+   them has been run, the per-scan cycle budget is unverified. */
+
+// main.c is built with main renamed to firmware_main; this is the
+// real one.
+#undef main
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../lib/usb_keyboard_debug.h"
+#include "../keylog.h"
+#include "sim.h"
+
+// The parts of main.c the bench drives.
+void init(void);
+void process_events(void);
+void replay_task(void);
+void macro_task(void);
+void SCAN_INTERRUPT_FUNCTION(void);
+extern uint8_t replaying;
+extern const uint8_t layouts[][NKEY];
+
+#define MAX_PRESSES 20000
+#define SLACK_MS    50  // a report this late still counts
+
+struct press {
+  uint8_t key;
+  uint32_t down, up;      // ms
+  uint8_t bounce_down;    // ms of chatter after each edge
+  uint8_t bounce_up;
+  uint8_t glitch;         // open for a ms every this many ms while held, 0 never
+};
+
+static struct press presses[MAX_PRESSES];
+static unsigned npresses;
+
+// Keys of the first layout that send a plain key code of their own.
+static uint8_t keys[NKEY], nkeys;
+static int key_by_code[256];
+
+static uint32_t rng = 1;
+static uint32_t rnd(uint32_t n) {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng % n;
+}
+
+// A stable pseudo-random bit for key k at time t, for chatter.
+static int noise(uint8_t k, uint32_t t) {
+  uint32_t x = (t * 2654435761u) ^ (k * 40503u) ^ 0x9E3779B9u;
+  x ^= x >> 15;
+  x *= 0x2C1B3C6Du;
+  x ^= x >> 12;
+  return x & 1;
+}
+
+/* Per-key checking state while a trace runs. */
+static struct {
+  int current;            // press in progress or last one, -1 none
+  uint8_t reported;       // in the last report
+  uint8_t seen_down;      // current press has been reported
+  uint8_t seen_up;        // and its release
+  unsigned reports;       // times it appeared in a report
+} key_state[NKEY];
+
+static struct {
+  unsigned scans, reports, missed, extra;
+  double isr_ns, loop_ns;
+  unsigned lat_n[2];
+  double lat_sum[2];
+  uint32_t lat_min[2], lat_max[2];
+} result;
+
+static void add_latency(int release, uint32_t ms) {
+  result.lat_n[release]++;
+  result.lat_sum[release] += ms;
+  if(ms < result.lat_min[release])
+    result.lat_min[release] = ms;
+  if(ms > result.lat_max[release])
+    result.lat_max[release] = ms;
+}
+
+static int reported_code(uint8_t code) {
+#ifdef NKRO
+  if(keyboard_protocol)
+    return code < KEYBOARD_NKRO_BYTES * 8 && (keyboard_nkro_keys[code / 8] & (1 << (code % 8)));
+#endif
+  for(int i = 0; i < 6; i++)
+    if(keyboard_keys[i] == code)
+      return 1;
+  return 0;
+}
+
+void sim_report(void) {
+  result.reports++;
+  for(int i = 0; i < nkeys; i++) {
+    uint8_t k = keys[i];
+    uint8_t now = reported_code(layouts[0][k]);
+    if(now == key_state[k].reported)
+      continue;
+    key_state[k].reported = now;
+    int p = key_state[k].current;
+    if(now) {
+      key_state[k].reports++;
+      if(p >= 0 && !key_state[k].seen_down) {
+        key_state[k].seen_down = 1;
+        add_latency(0, sim_time - presses[p].down);
+      }
+    } else if(p >= 0 && key_state[k].seen_down && !key_state[k].seen_up && sim_time >= presses[p].up) {
+      key_state[k].seen_up = 1;
+      add_latency(1, sim_time - presses[p].up);
+    }
+  }
+}
+
+static int closed(const struct press *p, uint32_t t) {
+  if(t < p->down || t >= p->up + p->bounce_up)
+    return 0;
+  if(t < p->down + p->bounce_down)
+    return noise(p->key, t);
+  if(t >= p->up)
+    return noise(p->key, t);
+  if(p->glitch && (t - p->down) % p->glitch == p->glitch - 1)
+    return 0;
+  return 1;
+}
+
+static int by_down(const void *a, const void *b) {
+  const struct press *x = a, *y = b;
+  return x->down < y->down ? -1 : x->down > y->down;
+}
+
+static double elapsed_ns(struct timespec *a, struct timespec *b) {
+  return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+static void run(const char *name) {
+  static int pos_of_key[NKEY]; // index into the sorted presses
+  uint32_t end = 0;
+  struct timespec t0, t1, t2;
+
+  qsort(presses, npresses, sizeof(presses[0]), by_down);
+  for(unsigned i = 0; i < npresses; i++)
+    if(presses[i].up + presses[i].bounce_up + SLACK_MS > end)
+      end = presses[i].up + presses[i].bounce_up + SLACK_MS;
+
+  memset(&result, 0, sizeof(result));
+  result.lat_min[0] = result.lat_min[1] = ~0u;
+  for(int k = 0; k < NKEY; k++) {
+    key_state[k].current = -1;
+    key_state[k].reported = key_state[k].seen_down = key_state[k].seen_up = 0;
+    key_state[k].reports = 0;
+    pos_of_key[k] = 0;
+  }
+
+  // Presses of one key never overlap, so each key walks its own list.
+  for(uint32_t t = 0; t < end; t += sim_slow ? IDLE_SCAN_MS : USB_POLL_MS) {
+    sim_time = t;
+    memset(sim_matrix, 0, sizeof(sim_matrix));
+    for(int i = 0; i < nkeys; i++) {
+      uint8_t k = keys[i];
+      int p = key_state[k].current;
+      if(p < 0 || t >= presses[p].up + presses[p].bounce_up) {
+        // Find the next press of k that has started.
+        for(unsigned j = pos_of_key[k]; j < npresses && presses[j].down <= t; j++) {
+          pos_of_key[k] = j + 1;
+          if(presses[j].key == k && (int)j != p) {
+            if(p >= 0 && !key_state[k].seen_down)
+              result.missed++;
+            key_state[k].current = p = j;
+            key_state[k].seen_down = key_state[k].seen_up = 0;
+            break;
+          }
+        }
+      }
+      if(p >= 0 && closed(&presses[p], t))
+        sim_matrix[k / NCOL] |= 1 << (k % NCOL);
+    }
+    sim_settle();
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    SCAN_INTERRUPT_FUNCTION();
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if(replaying)
+      replay_task();
+    else
+      process_events();
+    macro_task();
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+    result.isr_ns += elapsed_ns(&t0, &t1);
+    result.loop_ns += elapsed_ns(&t1, &t2);
+    result.scans++;
+  }
+
+  unsigned wanted[NKEY] = {0};
+  for(unsigned i = 0; i < npresses; i++)
+    wanted[presses[i].key]++;
+  for(int k = 0; k < NKEY; k++) {
+    if(key_state[k].current >= 0 && !key_state[k].seen_down)
+      result.missed++;
+    if(key_state[k].reports > wanted[k])
+      result.extra += key_state[k].reports - wanted[k];
+  }
+
+  printf("%-10s %7u %6u %6u %5u %8.1f %10.0f", name, result.scans, npresses * 2,
+         result.missed, result.extra, result.isr_ns / result.scans,
+         npresses * 2 / ((result.isr_ns + result.loop_ns) * 1e-9));
+  for(int r = 0; r < 2; r++) {
+    if(result.lat_n[r])
+      printf("  %3u %5.1f %3u", result.lat_min[r], result.lat_sum[r] / result.lat_n[r], result.lat_max[r]);
+    else
+      printf("    -     -   -");
+  }
+  printf("\n");
+}
+
+static void add_press(uint8_t k, uint32_t down, uint32_t up, uint8_t bounce, uint8_t glitch) {
+  if(npresses == MAX_PRESSES)
+    return;
+  presses[npresses].key = k;
+  presses[npresses].down = down;
+  presses[npresses].up = up;
+  presses[npresses].bounce_down = bounce ? rnd(bounce + 1) : 0;
+  presses[npresses].bounce_up = bounce ? rnd(bounce + 1) : 0;
+  presses[npresses].glitch = glitch;
+  npresses++;
+}
+
+// Keys are free again this long after their last release.
+static uint32_t free_at[NKEY];
+
+static uint8_t free_key(uint32_t t) {
+  for(;;) {
+    uint8_t k = keys[rnd(nkeys)];
+    if(free_at[k] <= t)
+      return k;
+  }
+}
+
+static void use_key(uint8_t k, uint32_t down, uint32_t up, uint8_t bounce, uint8_t glitch) {
+  add_press(k, down, up, bounce, glitch);
+  free_at[k] = up + bounce + 60;
+}
+
+// Fast typing with some overlap between consecutive keys.
+static void typing(uint8_t bounce, uint8_t glitch) {
+  uint32_t t = 100;
+  while(npresses < 4000) {
+    uint32_t hold = 40 + rnd(80);
+    use_key(free_key(t), t, t + hold, bounce, glitch);
+    t += 30 + rnd(120);
+  }
+}
+
+// Groups of four keys going down and up within a few ms.
+static void chords(void) {
+  for(uint32_t t = 100; npresses < 4000; t += 200) {
+    uint32_t hold = 80 + rnd(40);
+    for(int i = 0; i < 4; i++)
+      use_key(free_key(t), t + rnd(4), t + hold + rnd(4), 3, 0);
+  }
+}
+
+// Twenty keys rolled down 2 ms apart, held and rolled back up.
+static void rollover(void) {
+  for(uint32_t t = 100; npresses < 4000; t += 300) {
+    for(uint32_t i = 0; i < 20; i++)
+      use_key(free_key(t), t + 2 * i, t + 100 + 2 * i, 2, 0);
+  }
+}
+
+static void reset_trace(void) {
+  npresses = 0;
+  memset(free_at, 0, sizeof(free_at));
+}
+
+// Loaded traces are edges, paired up into presses here.
+static int open_press[NKEY];
+
+static void begin_edges(void) {
+  for(int i = 0; i < NKEY; i++)
+    open_press[i] = -1;
+  reset_trace();
+}
+
+static void add_edge(uint32_t t, unsigned long k, unsigned long state) {
+  if(k >= NKEY || npresses == MAX_PRESSES)
+    return;
+  if(state && open_press[k] < 0) {
+    open_press[k] = npresses;
+    add_press(k, t, t, 0, 0);
+  } else if(!state && open_press[k] >= 0) {
+    presses[open_press[k]].up = t;
+    open_press[k] = -1;
+  }
+}
+
+static void end_edges(void) {
+  for(int i = 0; i < NKEY; i++)
+    if(open_press[i] >= 0)
+      presses[open_press[i]].up = presses[open_press[i]].down + 100;
+}
+
+static int load_text(FILE *f) {
+  unsigned long t, k, state;
+  while(fscanf(f, "%lu %lu %lu", &t, &k, &state) == 3)
+    add_edge(t, k, state);
+  return 0;
+}
+
+// Times come from the USB frame of each sync and the scans since it,
+// at the full scan rate. The first sync is put at 100 ms.
+static int load_keylog(FILE *f, const char *path) {
+  static uint8_t log[1 << 20];
+  size_t n = fread(log, 1, sizeof(log), f);
+  const uint8_t *p = log, *end = log + n;
+  uint32_t v, frame, ms = 100, tick = 0, sync_tick = 0;
+  uint16_t sync_frame = 0;
+  int synced = 0;
+  while(p < end) {
+    if(!(p = keylog_get(p, end, &v)) || p == end)
+      break;
+    uint8_t key = *p++;
+    if(key == KEYLOG_SYNC) {
+      if(!(p = keylog_get(p, end, &frame)))
+        break;
+      if(synced)
+        ms += (uint16_t)(frame - sync_frame) - (tick - sync_tick) * USB_POLL_MS;
+      synced = 1;
+      tick = sync_tick = v >> 1;
+      sync_frame = frame;
+      if(v & 1)
+        fprintf(stderr, "%s: records lost before scan %u\n", path, (unsigned)tick);
+      continue;
+    }
+    if(!synced)
+      break;
+    tick += v >> 1;
+    ms += (v >> 1) * USB_POLL_MS;
+    add_edge(ms, key, v & 1);
+  }
+  if(p != end) {
+    fprintf(stderr, "%s: not a key log\n", path);
+    return -1;
+  }
+  return 0;
+}
+
+static int load(const char *path) {
+  FILE *f = fopen(path, "rb");
+  size_t len = strlen(path);
+  int r;
+  if(!f) {
+    perror(path);
+    return -1;
+  }
+  begin_edges();
+  if(len > 7 && strcmp(path + len - 7, ".keylog") == 0)
+    r = load_keylog(f, path);
+  else
+    r = load_text(f);
+  fclose(f);
+  end_edges();
+  return r;
+}
+
+int main(int argc, char **argv) {
+  for(int i = 0; i < 256; i++)
+    key_by_code[i] = -1;
+  for(int k = 0; k < NKEY; k++) {
+    uint8_t code = layouts[0][k];
+    if(IS_KEY_ACTION(code) && code != KEY_NO && key_by_code[code] < 0) {
+      key_by_code[code] = k;
+      keys[nkeys++] = k;
+    }
+  }
+
+  init();
+  printf("%u ms polls, %s\n", USB_POLL_MS,
+#ifdef NKRO
+         "NKRO"
+#else
+         "6KRO"
+#endif
+        );
+  printf("trace        scans events missed extra  host ns   events/s"
+         "  press ms min/avg/max  release ms\n");
+  if(argc > 1) {
+    for(int i = 1; i < argc; i++)
+      if(load(argv[i]) == 0)
+        run(argv[i]);
+    return 0;
+  }
+  reset_trace();
+  typing(0, 0);
+  run("typing");
+  reset_trace();
+  typing(5, 0);
+  run("chatter");
+  reset_trace();
+  typing(5, 15);
+  run("worn");
+  reset_trace();
+  chords();
+  run("chords");
+  reset_trace();
+  rollover();
+  run("rollover");
+  return 0;
+}
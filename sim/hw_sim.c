@@ -0,0 +1,127 @@
+/* Simulated keyboard hardware for the host bench: the matrix is read
+   from sim_matrix[] and the EEPROM is a RAM array. Like the real
+   boards the matrix has no diodes, so a pulled row also reads every
+   column reachable through other rows' closed switches. */
+
+#include <string.h>
+#include "../hw_interface.h"
+#include "../eeprom_map.h"
+#include <avr/eeprom.h>
+#include "sim.h"
+
+volatile uint8_t PINB, PINC, PIND;
+volatile uint8_t DDRB, DDRC, DDRD;
+volatile uint8_t PORTB, PORTC, PORTD;
+volatile uint8_t SREG;
+volatile uint8_t CLKPR, MCUCR;
+
+uint8_t sim_matrix[NROW];
+uint32_t sim_time;
+uint8_t sim_slow;
+
+static uint8_t pulled_row;
+static uint8_t eeprom[1024];
+
+uint16_t select_row(uint8_t r) {
+  pulled_row = r;
+  return 0;
+}
+
+void settle_row(uint8_t r, uint16_t since) {
+  (void)r;
+  (void)since;
+}
+
+void pull_row(uint8_t r) {
+  pulled_row = r;
+}
+
+void release_rows(void) {
+}
+
+static uint8_t wired[NROW];
+
+void sim_settle(void) {
+  for(uint8_t row = 0; row < NROW; row++) {
+    uint8_t cols = sim_matrix[row], more;
+    do {
+      more = 0;
+      for(uint8_t r = 0; r < NROW; r++)
+        if((sim_matrix[r] & cols) && (sim_matrix[r] & ~cols)) {
+          cols |= sim_matrix[r];
+          more = 1;
+        }
+    } while(more);
+    wired[row] = cols;
+  }
+}
+
+uint8_t read_columns(void) {
+  return wired[pulled_row];
+}
+
+void timer1_setup(void) {
+}
+
+void led_set(uint8_t led, uint16_t duty) {
+  (void)led;
+  (void)duty;
+}
+
+void keyboard_init(void) {
+  memset(eeprom, 0xFF, sizeof(eeprom));
+}
+
+void poll_timer_setup(void) {
+}
+
+void poll_timer_enable(void) {
+}
+
+void poll_timer_disable(void) {
+}
+
+void poll_timer_fast(void) {
+  sim_slow = 0;
+}
+
+void poll_timer_slow(void) {
+  sim_slow = 1;
+}
+
+uint16_t poll_timer_period(void) {
+  return F_CPU / 1000 * USB_POLL_MS;
+}
+
+void watchdog_sleep(void) {
+}
+
+// The simulated matrix settles at once.
+uint8_t settle_reference(uint8_t r) {
+  pull_row(r);
+  return read_columns();
+}
+
+uint8_t settle_measure(uint8_t r, uint8_t cols) {
+  (void)r;
+  (void)cols;
+  return 0;
+}
+
+uint8_t eeprom_read_byte(const uint8_t *addr) {
+  return eeprom[(uintptr_t)addr % sizeof(eeprom)];
+}
+
+void eeprom_update_byte(uint8_t *addr, uint8_t value) {
+  eeprom[(uintptr_t)addr % sizeof(eeprom)] = value;
+}
+
+void eeprom_read_block(void *dst, const void *src, size_t n) {
+  for(size_t i = 0; i < n; i++)
+    ((uint8_t *)dst)[i] = eeprom_read_byte((const uint8_t *)src + i);
+}
+
+void eeprom_update_block(const void *src, void *dst, size_t n) {
+  for(size_t i = 0; i < n; i++)
+    eeprom_update_byte((uint8_t *)dst + i, ((const uint8_t *)src)[i]);
+}
@@ -0,0 +1,20 @@
+#ifndef sim_h__
+#define sim_h__
+
+#include <stdint.h>
+#include KEYBOARD_MODEL
+
+// State shared between the simulated hardware and the bench.
+
+extern uint8_t sim_matrix[NROW];  // closed switches, bit c = column c
+extern uint32_t sim_time;         // ms since the simulation started
+extern uint8_t sim_slow;          // scanning at the idle rate
+
+// Work out what each row reads after sim_matrix[] changed.
+void sim_settle(void);
+
+// Called with every report the firmware sends, after keyboard_keys
+// and keyboard_modifier_keys (or the NKRO bitmap) are filled in.
+void sim_report(void);
+
+#endif
@@ -0,0 +1,75 @@
+/* Simulated USB device for the host bench. It is always configured,
+   and every report is handed to sim_report() as it is sent. */
+
+#include <string.h>
+#include "../lib/usb_keyboard_debug.h"
+#include "sim.h"
+
+uint8_t keyboard_modifier_keys = 0;
+uint8_t keyboard_keys[6] = {0, 0, 0, 0, 0, 0};
+volatile uint8_t keyboard_leds = 0;
+uint8_t keyboard_protocol = 1;
+#ifdef NKRO
+uint8_t keyboard_nkro_keys[KEYBOARD_NKRO_BYTES];
+#endif
+
+void usb_init(void) {
+}
+
+uint8_t usb_configured(void) {
+  return 1;
+}
+
+uint16_t usb_frame_number(void) {
+  return sim_time;
+}
+
+// The simulated bus is never suspended.
+uint8_t usb_suspended(void) {
+  return 0;
+}
+
+int8_t usb_remote_wakeup(void) {
+  return -1;
+}
+
+// Like the real one, a report the same as the last is skipped.
+int8_t usb_keyboard_send(void) {
+  static uint8_t sent[1 + 6 + KEYBOARD_NKRO_BYTES];
+  uint8_t report[sizeof(sent)] = {keyboard_modifier_keys};
+  memcpy(report + 1, keyboard_keys, 6);
+#ifdef NKRO
+  if(keyboard_protocol)
+    memcpy(report + 7, keyboard_nkro_keys, KEYBOARD_NKRO_BYTES);
+#endif
+  if(!memcmp(report, sent, sizeof(sent)))
+    return 1;
+  memcpy(sent, report, sizeof(sent));
+  sim_report();
+  return 0;
+}
+
+int8_t usb_keyboard_press(uint8_t key, uint8_t modifier) {
+  keyboard_modifier_keys = modifier;
+  keyboard_keys[0] = key;
+  usb_keyboard_send();
+  keyboard_modifier_keys = 0;
+  keyboard_keys[0] = 0;
+  return usb_keyboard_send();
+}
+
+void jump_bootloader(void) {
+}
+
+int8_t usb_debug_putchar(uint8_t c) {
+  (void)c;
+  return 0;
+}
+
+void usb_debug_flush_output(void) {
+}
+
+int8_t usb_debug_write_packet(const uint8_t *buf) {
+  (void)buf;
+  return 0;
+}
@@ -0,0 +1,7 @@
+#ifndef sim_util_delay_h__
+#define sim_util_delay_h__
+
+#define _delay_us(us)
+#define _delay_ms(ms)
+
+#endif
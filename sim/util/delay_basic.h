@@ -0,0 +1,6 @@
+#ifndef sim_util_delay_basic_h__
+#define sim_util_delay_basic_h__
+
+#define _delay_loop_1(count) ((void)(count))
+
+#endif
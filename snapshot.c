@@ -0,0 +1,56 @@
+/* USB Keyboard Firmware code for generic Teensy Keyboards
+ * Copyright (c) 2012 Fredrik Atmer, Bathroom Epiphanies Inc
+ * http://www.bathroomepiphanies.com
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Double-buffered copy of the de-bounced matrix for the main loop.
+   The scan interrupt fills the buffer the main loop is not reading,
+   then bumps a single byte sequence number whose low bit says which
+   buffer is the latest. A reader copies the latest buffer and checks
+   the sequence number again: if at most one scan finished meanwhile,
+   it wrote the other buffer and the copy is whole; otherwise the copy
+   is retried. The interrupt never waits and the reader never blocks
+   it. */
+
+#include "snapshot.h"
+
+static struct matrix_snapshot snapshots[2];
+static volatile uint8_t snapshot_seq = 0;
+
+void snapshot_publish(const uint8_t *rows, uint16_t tick) {
+  uint8_t seq = snapshot_seq + 1;
+  struct matrix_snapshot *s = &snapshots[seq & 1];
+  for(uint8_t r = 0; r < NROW; r++)
+    s->rows[r] = rows[r];
+  s->tick = tick;
+  snapshot_seq = seq;
+}
+
+uint8_t snapshot_read(struct matrix_snapshot *s) {
+  for(;;) {
+    uint8_t seq = snapshot_seq;
+    *s = snapshots[seq & 1];
+    if((uint8_t)(snapshot_seq - seq) < 2)
+      return seq;
+  }
+}
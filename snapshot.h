@@ -0,0 +1,23 @@
+#ifndef snapshot_h__
+#define snapshot_h__
+
+#include <stdint.h>
+#include KEYBOARD_MODEL
+
+// The de-bounced matrix as of the end of one scan, one byte per row
+// (bit c set = key in column c pressed), and the scan_tick of that
+// scan.
+struct matrix_snapshot {
+  uint16_t tick;
+  uint8_t rows[NROW];
+};
+
+// Publish the state at the end of a scan. Scan interrupt only.
+void snapshot_publish(const uint8_t *rows, uint16_t tick);
+
+// Copy the latest complete snapshot into s and return its sequence
+// number, which goes up by one with every scan. Never disables
+// interrupts. Main loop only.
+uint8_t snapshot_read(struct matrix_snapshot *s);
+
+#endif
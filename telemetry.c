@@ -0,0 +1,132 @@
+/* USB Keyboard Firmware code for generic Teensy Keyboards
+ * Copyright (c) 2012 Fredrik Atmer, Bathroom Epiphanies Inc
+ * http://www.bathroomepiphanies.com
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* Telemetry records wait in a RAM ring until the main loop finds a
+   free buffer on the debug endpoint, so recording one costs the scan
+   interrupt a few stores and never waits on the host. When the ring
+   is full records are counted and dropped, and the count goes out
+   with the next packet. Packets are built in place in the one packet
+   buffer, which the key log shares. */
+
+#include <avr/interrupt.h>
+#include "telemetry.h"
+#include "events.h"
+#include "lib/usb_keyboard_debug.h"
+
+// Two packets' worth: the main loop empties the ring every pass, and
+// a scan pushes at most a few records.
+#define TELEMETRY_RING_SIZE 8  // power of two
+#define RECORDS_PER_PACKET (USB_DEBUG_PACKET_SIZE / sizeof(struct telemetry_record))
+
+uint8_t telemetry_packet[USB_DEBUG_PACKET_SIZE];
+bool telemetry_packet_full = false;
+
+static struct telemetry_record ring[TELEMETRY_RING_SIZE];
+static volatile uint8_t head = 0;
+static uint8_t tail = 0;
+static volatile uint16_t dropped = 0;
+
+void telemetry_push(uint8_t type, uint8_t arg, uint16_t data) {
+  uint8_t intr_state = SREG;
+  cli();
+  uint8_t h = head;
+  if((uint8_t)(h - tail) == TELEMETRY_RING_SIZE) {
+    dropped++;
+  } else {
+    struct telemetry_record *r = &ring[h % TELEMETRY_RING_SIZE];
+    r->type = type;
+    r->arg = arg;
+    r->tick = scan_tick;
+    r->frame = usb_frame_number();
+    r->data = data;
+    head = h + 1;
+  }
+  SREG = intr_state;
+}
+
+// Hand the packet to the endpoint if it has a free buffer.
+static void flush(void) {
+  if(telemetry_packet_full && usb_debug_write_packet(telemetry_packet) == 0)
+    telemetry_packet_full = false;
+}
+
+void telemetry_send(struct telemetry_record *r, uint8_t n) {
+  struct telemetry_record *p = (struct telemetry_record *)telemetry_packet;
+  uint8_t intr_state;
+  while(n) {
+    // Give up on a host that is not listening.
+    uint16_t start = usb_frame_number();
+    for(flush(); telemetry_packet_full; flush())
+      if((uint16_t)(usb_frame_number() - start) > 50)
+        return;
+    intr_state = SREG;
+    cli();
+    uint16_t tick = scan_tick;
+    SREG = intr_state;
+    for(uint8_t i = 0; i < RECORDS_PER_PACKET; i++) {
+      if(n) {
+        p[i] = *r++;
+        p[i].tick = tick;
+        p[i].frame = usb_frame_number();
+        n--;
+      } else {
+        p[i].type = TELEMETRY_NONE;
+      }
+    }
+    telemetry_packet_full = true;
+    flush();
+  }
+}
+
+void telemetry_task(void) {
+  struct telemetry_record *p = (struct telemetry_record *)telemetry_packet;
+  uint8_t n = 0, intr_state;
+
+  flush();
+  if(telemetry_packet_full)
+    return;
+  intr_state = SREG;
+  cli();
+  if(dropped) {
+    p[0].type = TELEMETRY_DROPPED;
+    p[0].arg = 0;
+    p[0].tick = scan_tick;
+    p[0].frame = usb_frame_number();
+    p[0].data = dropped;
+    dropped = 0;
+    n = 1;
+  }
+  SREG = intr_state;
+  while(n < RECORDS_PER_PACKET && tail != head) {
+    p[n++] = ring[tail % TELEMETRY_RING_SIZE];
+    tail++;
+  }
+  if(!n)
+    return;
+  for(uint8_t i = n; i < RECORDS_PER_PACKET; i++)
+    p[i].type = TELEMETRY_NONE;
+  telemetry_packet_full = true;
+  flush();
+}
@@ -0,0 +1,63 @@
+#ifndef telemetry_h__
+#define telemetry_h__
+
+#include <stdint.h>
+#include "lib/avr_extra.h"
+#include "lib/usb_keyboard_debug.h"
+
+// Binary telemetry on the debug interface. Records are 8 bytes, four
+// to a packet; unused slots in a packet are TELEMETRY_NONE.
+struct telemetry_record {
+  uint8_t type;
+  uint8_t arg;
+  uint16_t tick;   // scan_tick when recorded
+  uint16_t frame;  // USB frame when recorded
+  uint16_t data;
+};
+
+#define TELEMETRY_NONE    0
+#define TELEMETRY_EDGE    1  // arg = key, data = 1 pressed, 0 released
+#define TELEMETRY_REPORT  2  // arg = modifiers, data = keys in the report
+#define TELEMETRY_OVERRUN 3  // data = key events lost so far
+#define TELEMETRY_DROPPED 4  // data = records lost since the last one of these
+
+// Statistics from instrument_dump(), scan times in cycles and
+// latencies in microseconds. arg says which value data holds: min,
+// max, mean, sample count, scan period, or the count of bucket
+// arg - TELEMETRY_STAT_BUCKET.
+#define TELEMETRY_SCAN_STAT    5
+#define TELEMETRY_LATENCY_STAT 6
+#define TELEMETRY_STAT_MIN     0
+#define TELEMETRY_STAT_MAX     1
+#define TELEMETRY_STAT_MEAN    2
+#define TELEMETRY_STAT_COUNT   3
+#define TELEMETRY_STAT_PERIOD  4
+#define TELEMETRY_STAT_BUCKET  0x10
+
+// From matrix_dump_chatter(): arg = key, data = bounces counted.
+#define TELEMETRY_CHATTER 7
+
+// A whole packet of key log records, see keylog.h: this type byte,
+// the number of bytes of records, and the records.
+#define TELEMETRY_KEYLOG 8
+
+#ifdef TELEMETRY
+// Queue a record. Safe from the scan interrupt and the main loop.
+void telemetry_push(uint8_t type, uint8_t arg, uint16_t data);
+// Send queued records when the debug endpoint has room. Main loop only.
+void telemetry_task(void);
+// Send n records straight away, bypassing the ring and waiting for
+// the endpoint. The tick and frame fields are filled in. Main loop only.
+void telemetry_send(struct telemetry_record *r, uint8_t n);
+
+// The one packet on its way to the debug endpoint, shared by all that
+// send there. Fill it only while telemetry_packet_full is false, then
+// set it; telemetry_task() hands it to the endpoint. Main loop only.
+extern uint8_t telemetry_packet[USB_DEBUG_PACKET_SIZE];
+extern bool telemetry_packet_full;
+#else
+#define telemetry_push(type, arg, data)
+#define telemetry_task()
+#endif
+
+#endif
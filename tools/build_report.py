@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+"""Print flash and RAM use, worst-case stack depth and scan interrupt
+cycles of firmware builds, one line per build directory.
+
+    make -j matrix                      # builds build/* and runs this
+    tools/build_report.py build/hoof_ANSI_ISO_JIS ...
+
+Sizes come from avr-size, flash counted against what is left below
+the bootloader. Stack depths add up the -fstack-usage frames (*.su,
+which include the return address) along the deepest path of the call
+graph from main, plus the deepest interrupt on top of it, as
+interrupts do not nest. Calls through pointers are not seen. The
+exit status is 1 if a build's data, bss and deepest stack do not fit
+below RAMEND - 0x100, or its flash reaches into the bootloader.
+
+The scan cycle figure is one pass through the scan interrupt and
+everything it calls, each instruction counted once with branches not
+taken: with SCAN=unrolled that is close to a quiet scan, with the
+looped scan it is one row. INSTRUMENT builds measure the real thing.
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+
+# Flash below the bootloader, which the ATmega32U2 keeps at 0x7000.
+FLASH_SIZE = 0x7000
+# Data, bss and the deepest stack must fit below RAMEND - 0x100, 0x3FF
+# on the ATmega32U2, whose SRAM starts at 0x100.
+RAMEND = 0x4FF
+
+SYMBOL = re.compile(r'^[0-9a-f]+ <([^>]+)>:$')
+INSN = re.compile(r'^\s*[0-9a-f]+:\s+(?:[0-9a-f]{2} )+\s*(\S+)\s*([^;]*)(?:;.*<([^>+]+)>)?')
+TARGET = re.compile(r'<([^>+]+)>')
+
+# Cycles of the ATmega32U2 instructions that take more than one.
+CYCLES = {
+    'adiw': 2, 'sbiw': 2, 'mul': 2, 'muls': 2, 'mulsu': 2,
+    'fmul': 2, 'fmuls': 2, 'fmulsu': 2,
+    'ld': 2, 'ldd': 2, 'lds': 2, 'st': 2, 'std': 2, 'sts': 2,
+    'push': 2, 'pop': 2, 'cbi': 2, 'sbi': 2,
+    'lpm': 3, 'elpm': 3, 'spm': 4,
+    'rjmp': 2, 'ijmp': 2, 'jmp': 3, 'rcall': 3, 'icall': 3, 'call': 4,
+    'ret': 4, 'reti': 4,
+}
+CALLS = ('call', 'rcall')
+
+
+def run(*args):
+    return subprocess.run(args, check=True, capture_output=True, text=True).stdout
+
+
+def sizes(size, elf):
+    sections = {}
+    for line in run(size, '-A', elf).splitlines():
+        fields = line.split()
+        if len(fields) >= 2 and fields[0].startswith('.') and fields[1].isdigit():
+            sections[fields[0]] = int(fields[1])
+    flash = sections.get('.text', 0) + sections.get('.data', 0)
+    ram = sum(sections.get(s, 0) for s in ('.data', '.bss', '.noinit'))
+    return flash, ram
+
+
+def functions(objdump, elf):
+    """Map each function to (cycles of one pass, functions it calls)."""
+    funcs = {}
+    current = None
+    for line in run(objdump, '-d', elf).splitlines():
+        m = SYMBOL.match(line)
+        if m:
+            current = funcs.setdefault(m.group(1), [0, []])
+            continue
+        m = INSN.match(line)
+        if not m or current is None:
+            continue
+        op = m.group(1)
+        current[0] += CYCLES.get(op, 1)
+        if op in CALLS:
+            target = m.group(3) or (TARGET.search(m.group(2)) or [None, None])[1]
+            if target:
+                current[1].append(target)
+    return funcs
+
+
+def stack_usage(directory):
+    frames = {}
+    for root, _, files in os.walk(directory):
+        for name in files:
+            if not name.endswith('.su'):
+                continue
+            with open(os.path.join(root, name)) as f:
+                for line in f:
+                    fields = line.split('\t')
+                    if len(fields) >= 2:
+                        frames[fields[0].rsplit(':', 1)[-1]] = int(fields[1])
+    return frames
+
+
+def deepest(func, funcs, frames, seen=()):
+    if func in seen or func not in funcs:
+        return 0
+    below = [deepest(c, funcs, frames, seen + (func,)) for c in funcs[func][1]]
+    return frames.get(func, 2) + max(below, default=0)
+
+
+def one_pass(func, funcs, seen=()):
+    if func in seen or func not in funcs:
+        return 0
+    cycles, calls = funcs[func]
+    return cycles + sum(one_pass(c, funcs, seen + (func,)) for c in calls)
+
+
+def reachable(func, funcs, seen=None):
+    seen = set() if seen is None else seen
+    if func in funcs and func not in seen:
+        seen.add(func)
+        for c in funcs[func][1]:
+            reachable(c, funcs, seen)
+    return seen
+
+
+def ram_size(args):
+    return args.ramend - 0x100
+
+
+def report(directory, args):
+    elf = os.path.join(directory, 'main.elf')
+    flash, ram = sizes(args.size, elf)
+    funcs = functions(args.objdump, elf)
+    frames = stack_usage(directory)
+    vectors = [f for f in funcs if f.startswith('__vector_')]
+    isr_stack = max((deepest(v, funcs, frames) for v in vectors), default=0)
+    stack = deepest('main', funcs, frames) + isr_stack
+    # The scan interrupt is the one that runs the matrix filter.
+    scan = [v for v in vectors if 'matrix_filter' in reachable(v, funcs)]
+    cycles = one_pass(scan[0], funcs) if scan else 0
+    budget = args.f_cpu // 1000 * args.poll_ms
+    print('%-24s %6d %3d%% %5d %3d%% %5d %5d %7d %3d%%' % (
+        os.path.basename(directory.rstrip('/')),
+        flash, 100 * flash // args.flash_size, ram, 100 * ram // ram_size(args),
+        stack, ram_size(args) - ram - stack, cycles, 100 * cycles // budget))
+    return flash <= args.flash_size and ram + stack <= ram_size(args)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('--size', default='avr-size')
+    parser.add_argument('--objdump', default='avr-objdump')
+    parser.add_argument('--flash-size', type=lambda s: int(s, 0), default=FLASH_SIZE,
+                        help='flash below the bootloader (default 0x7000)')
+    parser.add_argument('--ramend', type=lambda s: int(s, 0), default=RAMEND,
+                        help='last SRAM address (default 0x4FF)')
+    parser.add_argument('--f-cpu', type=int, default=16000000)
+    parser.add_argument('--poll-ms', type=int, default=1)
+    parser.add_argument('dirs', nargs='+')
+    args = parser.parse_args()
+    print('%-24s %6s %4s %5s %4s %5s %5s %7s %4s' % (
+        'build', 'flash', '', 'ram', '', 'stack', 'free', 'scan', 'poll'))
+    ok = True
+    for d in args.dirs:
+        ok = report(d, args) and ok
+    if not ok:
+        print('over the %d bytes of flash below the bootloader, or data, bss and'
+              ' stack over the %d bytes below RAMEND - 0x100' % (args.flash_size, ram_size(args)))
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
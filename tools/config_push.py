@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""Push a key map to a CONFIG_UPDATE=true firmware over feature reports
+on its debug interface, to use as one more layout without reflashing.
+
+    tools/config_push.py /dev/hidrawN keymap.bin
+    tools/config_push.py --layout 1 /dev/hidrawN build/hoof_DVORAK/main.elf
+
+A key map is one action byte per key, a raw file of exactly that many
+bytes or one of the layouts of a firmware image. The firmware checks
+its CRC-16 once it is all in EEPROM, then switches to it. See config.h.
+"""
+
+import argparse
+import fcntl
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+FEATURE_SIZE = 32
+CHUNK = FEATURE_SIZE - 4
+VERSION = 1
+
+BEGIN, DATA, COMMIT = 1, 2, 3
+IDLE, RECEIVING, WRITING, DONE, FAILED = range(5)
+ERRORS = ['ok', 'bad command', 'bad version', 'bad length', 'bad offset', 'bad CRC']
+STATUS = struct.Struct('<BBBHHHBB')
+
+
+def ioc(nr, size):
+    # _IOC(_IOC_READ | _IOC_WRITE, 'H', nr, size)
+    return 3 << 30 | size << 16 | ord('H') << 8 | nr
+
+
+def set_feature(dev, data):
+    # Report number 0 first: the debug interface has no report IDs.
+    buf = bytearray(1 + FEATURE_SIZE)
+    buf[1:1 + len(data)] = data
+    fcntl.ioctl(dev, ioc(0x06, len(buf)), buf)
+
+
+def status(dev):
+    buf = bytearray(1 + FEATURE_SIZE)
+    fcntl.ioctl(dev, ioc(0x07, len(buf)), buf)
+    return STATUS.unpack_from(buf, 1)
+
+
+def crc16(data):
+    # avr-libc _crc16_update, from 0xFFFF
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = crc >> 1 ^ 0xA001 if crc & 1 else crc >> 1
+    return crc
+
+
+def layout_from_elf(elf, layout, nkey, nm, objcopy):
+    for line in subprocess.run([nm, '-S', elf], check=True, capture_output=True,
+                               text=True).stdout.splitlines():
+        fields = line.split()
+        if len(fields) == 4 and fields[3] == 'layouts':
+            address, size = int(fields[0], 16), int(fields[1], 16)
+            break
+    else:
+        sys.exit('%s: no layouts symbol' % elf)
+    if (layout + 1) * nkey > size:
+        sys.exit('%s has %d layouts of %d keys' % (elf, size // nkey, nkey))
+    with tempfile.NamedTemporaryFile() as image:
+        subprocess.run([objcopy, '-O', 'binary', elf, image.name], check=True)
+        flash = image.read()
+    start = address + layout * nkey
+    return flash[start:start + nkey]
+
+
+def wait(dev, done, what):
+    for _ in range(200):
+        st = status(dev)
+        if st[0] == FAILED:
+            sys.exit('%s: %s' % (what, ERRORS[st[1]] if st[1] < len(ERRORS) else st[1]))
+        if done(st):
+            return st
+        time.sleep(0.01)
+    sys.exit('%s: timed out' % what)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('--layout', type=int, default=0,
+                        help='layout to take from an ELF image (default 0)')
+    parser.add_argument('--nm', default='avr-nm')
+    parser.add_argument('--objcopy', default='avr-objcopy')
+    parser.add_argument('device')
+    parser.add_argument('keymap')
+    args = parser.parse_args()
+
+    with open(args.device, 'rb+', buffering=0) as dev:
+        state, error, version, nkey, received, written, seq, valid = status(dev)
+        if version != VERSION:
+            sys.exit('firmware speaks config version %d, not %d' % (version, VERSION))
+        if args.keymap.endswith('.elf'):
+            keymap = layout_from_elf(args.keymap, args.layout, nkey, args.nm, args.objcopy)
+        else:
+            with open(args.keymap, 'rb') as f:
+                keymap = f.read()
+        if len(keymap) != nkey:
+            sys.exit('%s: %d bytes, the firmware has %d keys' % (args.keymap, len(keymap), nkey))
+
+        set_feature(dev, struct.pack('<BBH', BEGIN, VERSION, nkey))
+        wait(dev, lambda st: st[0] == RECEIVING, 'begin')
+        for offset in range(0, nkey, CHUNK):
+            chunk = keymap[offset:offset + CHUNK]
+            set_feature(dev, struct.pack('<BHB', DATA, offset, len(chunk)) + chunk)
+            end = offset + len(chunk)
+            wait(dev, lambda st: st[5] == end, 'data at %d' % offset)
+        set_feature(dev, struct.pack('<BH', COMMIT, crc16(keymap)))
+        st = wait(dev, lambda st: st[0] == DONE, 'commit')
+        print('key map %d in use' % st[6])
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""Decode the binary telemetry a TELEMETRY=true firmware sends on its
+debug interface.
+
+    tools/telemetry.py /dev/hidrawN     # Linux, the debug interface
+    tools/telemetry.py capture.bin      # raw 32-byte packets saved earlier
+    tools/telemetry.py --keylog session.keylog /dev/hidrawN
+
+Each packet holds four 8-byte records: type, arg, scan tick, USB frame
+and data, little-endian. See telemetry.h. A KEYLOG=true firmware also
+sends key log packets, see keylog.h; --keylog appends their records to
+a file that sim/bench replays.
+"""
+
+import argparse
+import struct
+import sys
+
+PACKET_SIZE = 32
+RECORD = struct.Struct('<BBHHH')
+
+NONE, EDGE, REPORT, OVERRUN, DROPPED, SCAN_STAT, LATENCY_STAT, CHATTER, KEYLOG = range(9)
+KEYLOG_SYNC = 0xFF
+STAT_NAMES = ['min', 'max', 'mean', 'samples', 'scan period']
+STAT_BUCKET = 0x10
+
+
+def describe(rtype, arg, data):
+    if rtype == EDGE:
+        return 'key %3d %s' % (arg, 'down' if data else 'up')
+    if rtype == REPORT:
+        return 'report  mods %02x, %d keys' % (arg, data)
+    if rtype == OVERRUN:
+        return 'event queue overrun, %d events lost in total' % data
+    if rtype == DROPPED:
+        return '%d telemetry records dropped' % data
+    if rtype in (SCAN_STAT, LATENCY_STAT):
+        what = 'scan cycles' if rtype == SCAN_STAT else 'latency us'
+        if arg >= STAT_BUCKET:
+            bits = arg - STAT_BUCKET
+            low = 1 << (bits - 1) if bits else 0
+            return '%s %5d-%5d: %d' % (what, low, (1 << bits) - 1, data)
+        if arg < len(STAT_NAMES):
+            return '%s %s %d' % (what, STAT_NAMES[arg], data)
+    if rtype == CHATTER:
+        return 'key %3d chattered %d times' % (arg, data)
+    return 'unknown record %d (%02x %04x)' % (rtype, arg, data)
+
+
+def varint(data, pos):
+    value = shift = 0
+    while True:
+        b = data[pos]
+        pos += 1
+        value |= (b & 0x7F) << shift
+        if not b & 0x80:
+            return value, pos
+        shift += 7
+
+
+def keylog_lines(data):
+    """Describe the records of a key log packet payload."""
+    pos = tick = frame = 0
+    while pos < len(data):
+        v, pos = varint(data, pos)
+        key = data[pos]
+        pos += 1
+        if key == KEYLOG_SYNC:
+            frame, pos = varint(data, pos)
+            tick = v >> 1
+            if v & 1:
+                yield '%5d %5d  key log records lost' % (tick & 0xFFFF, frame)
+            continue
+        tick += v >> 1
+        yield '%5d %5s  key %3d %s' % (tick & 0xFFFF, '', key, 'down' if v & 1 else 'up')
+
+
+def packets(stream):
+    while True:
+        packet = stream.read(PACKET_SIZE)
+        if len(packet) < PACKET_SIZE:
+            return
+        yield packet
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('--keylog', help='append key log records to this file')
+    parser.add_argument('source')
+    args = parser.parse_args()
+    keylog = open(args.keylog, 'ab') if args.keylog else None
+    with open(args.source, 'rb', buffering=0) as stream:
+        try:
+            for packet in packets(stream):
+                if packet[0] == KEYLOG:
+                    payload = packet[2:2 + packet[1]]
+                    if keylog:
+                        keylog.write(payload)
+                        keylog.flush()
+                    for line in keylog_lines(payload):
+                        print(line)
+                    sys.stdout.flush()
+                    continue
+                for offset in range(0, PACKET_SIZE, RECORD.size):
+                    rtype, arg, tick, frame, data = RECORD.unpack_from(packet, offset)
+                    if rtype != NONE:
+                        print('%5d %5d  %s' % (tick, frame, describe(rtype, arg, data)))
+                sys.stdout.flush()
+        except KeyboardInterrupt:
+            pass
+
+
+if __name__ == '__main__':
+    main()